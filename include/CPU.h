@@ -1,10 +1,38 @@
 #ifndef CPU_H
 #define CPU_H
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
 #include "CPUOpcodes.h"
+#include "CPUProfiler.h"
+#include "CPUTrace.h"
 #include "MainBus.h"
+#include "Snapshot.h"
+#include "Watchpoints.h"
 
 namespace sn
 {
+    //Execution of hot PRG-ROM blocks through their translation to micro-ops instead of the interpreter.
+    //In verify mode each translated block is run by the interpreter as well and the results compared
+    enum TranslationMode
+    {
+        TranslationOff,
+        TranslationOn,
+        TranslationVerify,
+    };
+
+    //Instruction accuracy executes whole instructions and leaves catching up the other components to the
+    //caller, with all the caching and skipping for speed. Of the dummy accesses only the ones with side effects
+    //are made, reads of the I/O registers and writes outside internal RAM; the caller finds the cycle of any access
+    //with getAccessCycle. Cycle accuracy performs every bus access of the hardware, dummy ones included, on its own
+    //cycle and runs the cycle callback before each of them
+    enum CPUAccuracy
+    {
+        InstructionAccuracy,
+        CycleAccuracy,
+    };
 
     class CPU
     {
@@ -12,38 +40,365 @@ namespace sn
 
             CPU(MainBus &mem);
 
-            void step();
+            //Executes whole instructions until at least cycleBudget cycles are used.
+            //At least one instruction is executed, so the budget can be overshot by less than one instruction.
+            //Returns the number of cycles consumed
+            int run(int cycleBudget);
             void reset();
             void reset(Address start_addr);
+            //Logs the registers
             void log();
 
             Address getPC() { return r_PC; }
+            std::uint64_t getInstructionCount() { return m_instructionCount; }
+            //Whether the registers and the counts of cycles and instructions are the same as the other CPU's
+            bool isInSameState(CPU& other);
             void skipDMACycles();
 
             void interrupt(InterruptType type);
 
+            //Must be called when the mapper switches the PRG-ROM banks visible to the CPU
+            void updatePRGBanks();
+
+            void setTranslation(TranslationMode mode) { m_translation = mode; }
+            //Cycles from the start of the next instruction within which the instructions of a translated block
+            //have to start, up to the time something could interrupt the CPU or the caller stops it. The ones
+            //after that are left to the interpreter, so an interrupt is taken after the same instruction
+            void setTranslationBudget(int cycles) { m_translationBudget = cycles; }
+
+            void setAccuracy(CPUAccuracy accuracy);
+            CPUAccuracy getAccuracy() { return m_accuracy; }
+            //Called once per CPU cycle with cycle accuracy, before the bus access of that cycle
+            void setCycleCallback(std::function<void(void)> callback) { m_cycleCallback = callback; }
+            //Cycle of the instruction being executed, counted from 1, on which the bus access in progress is made.
+            //Without cycle accuracy it is worked out from the instruction, the access only happens as it ends
+            int getAccessCycle(bool write);
+
+            //Records every executed instruction while set. Translated blocks and skipped idle loops
+            //would leave gaps in the trace, so both are off meanwhile
+            void setTrace(CPUTrace* trace) { m_trace = trace; }
+            //Accounts every executed instruction to its location and call stack while set,
+            //translated blocks and idle loop skipping are off meanwhile as well
+            void setProfiler(CPUProfiler* profiler) { m_profiler = profiler; }
+            //Checks the execute breakpoints, which end the cached blocks before them and are checked on the
+            //uncached path. Translated blocks and skipped idle loops would bypass the bus, so both are off meanwhile
+            void setWatchpoints(Watchpoints* watchpoints);
+
+            //Length in cycles of the idle loop the CPU is waiting in, 0 if it isn't in one.
+            //An idle loop only reads RAM or PPUSTATUS and branches back to itself, and the last
+            //iteration left the registers unchanged. So until whatever it reads changes, or an
+            //interrupt arrives, every further iteration is exactly the same
+            int getIdleLoopCycles();
+            //Whether the idle loop reads PPUSTATUS
+            bool isIdleLoopPollingStatus() { return m_idleBlock->pollsStatus; }
+            //Accounts for the given iterations of the idle loop without executing them
+            void skipIdleLoop(int iterations);
+            //Total cycles skipped in idle loops
+            std::uint64_t getIdleCycles() { return m_idleCycles; }
+
+            //Registers, pending interrupts and the position in the block cache. The decoded blocks are kept
+            //as they are, they only depend on the PRG-ROM. The mapper must be loaded first
+            void saveState(Snapshot& snapshot);
+            void loadState(Snapshot& snapshot);
+
         private:
+            //Steps until at least cycleBudget cycles are used
+            template <bool profiling, CPUAccuracy accuracy>
+            int runSteps(int cycleBudget);
+            //Executes one instruction, or an interrupt sequence, and returns its length in cycles
+            template <bool profiling, CPUAccuracy accuracy>
+            int step();
+            template <CPUAccuracy accuracy>
+            int finishStep();
+            void traceInstruction(Address pc, Byte opcode);
+
+            //Handlers for the decoded instructions, the addressing mode resolves the location
+            //of the operand (advancing the PC) and the operation is then executed on it
+            using AddressingMode = Address (CPU::*)();
+            using Operation = void (CPU::*)(Address location);
+            //Executes a whole instruction, specialized for its addressing mode and operation
+            using Handler = void (CPU::*)();
+
+            //One handler is generated for every pair used by an opcode, with both calls resolved
+            //at compile time so that they can be inlined
+            template <AddressingMode addressing, Operation operation>
+            void execute();
+
+            struct Instruction
+            {
+                AddressingMode addressing;
+                Operation operation;
+                Handler handler;
+                int cycles; //0 implies unused opcode
+                int length; //opcode and operand bytes
+                bool endsBlock; //control flow, no instruction can follow it in a block
+                bool readModifyWrite; //reads its operand two cycles before writing it back
+            };
+
+            //An instruction decoded from PRG-ROM along with its operand bytes
+            struct DecodedInstruction
+            {
+                const Instruction* instruction;
+                Address operand;
+            };
+
+            //Operations a block can be translated to, their operands are resolved when translating
+            enum TranslatedOperation
+            {
+                TrLDA, TrLDX, TrLDY, TrSTA, TrSTX, TrSTY,
+                TrORA, TrAND, TrEOR, TrADC, TrSBC, TrCMP, TrCPX, TrCPY, TrBIT,
+                TrASL, TrLSR, TrROL, TrROR, TrINC, TrDEC,
+                TrASLA, TrLSRA, TrROLA, TrRORA,
+                TrTAX, TrTAY, TrTXA, TrTYA, TrTSX, TrTXS,
+                TrINX, TrINY, TrDEX, TrDEY,
+                TrCLC, TrSEC, TrCLD, TrSED, TrCLV, TrNOP,
+            };
+
+            enum TranslatedOperand
+            {
+                NoOperand,
+                ImmediateOperand,
+                MemoryOperand,      //fixed location in RAM
+                ZeroPageXOperand,   //zero page base, indexed at run time
+                ZeroPageYOperand,
+            };
+
+            struct TranslatedInstruction
+            {
+                TranslatedOperation operation;
+                TranslatedOperand operandMode;
+                Byte* memory; //location in RAM, or the start of the zero page for indexed operands
+                Byte value;   //immediate operand or zero page base
+                Byte cycles;  //none of the translated addressing modes has a page crossing penalty
+                Byte length;  //in bytes
+            };
+
+            //Straight-line run of instructions decoded from one 8KB PRG-ROM bank
+            struct DecodedBlock
+            {
+                std::vector<DecodedInstruction> instructions;
+                int executions;
+                bool translated;
+                //Translation of the leading instructions that only touch registers and internal RAM,
+                //so that they can be run without going through the bus. Empty if there are none
+                std::vector<TranslatedInstruction> translation;
+                bool idleLoop;
+                bool pollsStatus;
+            };
+
+            //Executions of a block before it gets translated
+            static const int TranslationThreshold = 16;
+            //Blocks of one bank, indexed by the offset of their first instruction in the bank
+            using BankBlocks = std::vector<std::unique_ptr<DecodedBlock>>;
+
+            //Returns the decoded block starting at r_PC, nullptr if it cannot be cached
+            DecodedBlock* findBlock();
+            void decodeBlock(DecodedBlock& block, Address addr);
+            void clearBlockCache();
+            void executeDecoded(const DecodedInstruction& decoded);
+            //pc, sp and bank are those before the instruction was executed
+            template <CPUAccuracy accuracy>
+            void profileInstruction(int bank, Address pc, Byte sp, const Instruction& instruction, int cycles);
+            void detectIdleLoop(DecodedBlock& block, Address addr);
+
+            //Micro-op translation, see CPUTranslation.cpp
+            void translateBlock(DecodedBlock& block);
+            bool translateInstruction(const DecodedInstruction& decoded, TranslatedInstruction& translated);
+            //Runs the translation of the block at r_PC as far as the translation budget, returns the cycles taken
+            int runTranslation(const DecodedBlock& block);
+            int verifyTranslation(const DecodedBlock& block);
+            Byte translatedOperand(const TranslatedInstruction& instruction);
+            Byte* translatedLocation(const TranslatedInstruction& instruction);
+            Byte translatedShift(TranslatedOperation operation, Byte value);
+
+            //Registers and flags, used to compare translated blocks against the interpreter
+            struct RegisterState
+            {
+                Address pc;
+                Byte a, x, y, sp, p;
+            };
+            RegisterState saveRegisters();
+            void restoreRegisters(const RegisterState& state);
+            static bool sameRegisters(const RegisterState& a, const RegisterState& b);
+
+            //Built once from OperationCycles and the opcode masks, for each accuracy. The decoded blocks and
+            //their translation only exist with instruction accuracy and always refer to InstructionTable
+            static const std::array<Instruction, 0x100> InstructionTable;
+            static const std::array<Instruction, 0x100> CycleInstructionTable;
+            template <CPUAccuracy accuracy>
+            static std::array<Instruction, 0x100> buildInstructionTable();
+
+            //Addressing mode and operation of an opcode along with their handler
+            struct Specialization
+            {
+                AddressingMode addressing;
+                Operation operation;
+                Handler handler;
+            };
+            template <AddressingMode addressing, Operation operation>
+            static Specialization specialize();
+            //Specializations of one operation, indexed by the addressing mode bits of the opcode.
+            //Those not valid for the operation are left empty
+            using Specializations = std::array<Specialization, 8>;
+            template <CPUAccuracy accuracy, Operation operation, bool pageCrossPenalty = true>
+            static Specializations type1Specializations();
+            //LDX and STX index by Y instead of X
+            template <CPUAccuracy accuracy, Operation operation, bool indexedByY = false>
+            static Specializations type2Specializations();
+
+            //Everything that accesses the bus is compiled for each accuracy, so that the accuracy is resolved
+            //with the rest of the handler instead of being checked on every access
+            template <CPUAccuracy accuracy>
             void interruptSequence(InterruptType type);
 
-            //Instructions are split into five sets to make decoding easier.
-            //These functions return true if they succeed
-            bool executeImplied(Byte opcode);
-            bool executeBranch(Byte opcode);
-            bool executeType0(Byte opcode);
-            bool executeType1(Byte opcode);
-            bool executeType2(Byte opcode);
+            //Addressing modes
+            Address addrImplied();
+            Address addrImmediate();
+            Address addrZeroPage();
+            template <CPUAccuracy accuracy> Address addrZeroPageX();
+            template <CPUAccuracy accuracy> Address addrZeroPageY();
+            Address addrAbsolute();
+            //Stores don't take the extra cycle on page crossing, it is already in their cycle count
+            template <CPUAccuracy accuracy, bool pageCrossPenalty> Address addrAbsoluteX();
+            template <CPUAccuracy accuracy, bool pageCrossPenalty> Address addrAbsoluteY();
+            template <CPUAccuracy accuracy> Address addrIndexedIndirectX();
+            template <CPUAccuracy accuracy, bool pageCrossPenalty> Address addrIndirectY();
+            //Adds the index to the address of an indexed mode
+            template <CPUAccuracy accuracy, bool pageCrossPenalty> Address addIndex(Address location, Byte index);
+
+            //Implied instructions
+            void opNOP(Address);
+            template <CPUAccuracy accuracy> void opBRK(Address);
+            template <CPUAccuracy accuracy> void opJSR(Address);
+            template <CPUAccuracy accuracy> void opRTS(Address);
+            template <CPUAccuracy accuracy> void opRTI(Address);
+            void opJMP(Address);
+            template <CPUAccuracy accuracy> void opJMPI(Address);
+            template <CPUAccuracy accuracy> void opPHP(Address);
+            template <CPUAccuracy accuracy> void opPLP(Address);
+            template <CPUAccuracy accuracy> void opPHA(Address);
+            template <CPUAccuracy accuracy> void opPLA(Address);
+            void opDEY(Address);
+            void opDEX(Address);
+            void opTAY(Address);
+            void opINY(Address);
+            void opINX(Address);
+            void opCLC(Address);
+            void opSEC(Address);
+            void opCLI(Address);
+            void opSEI(Address);
+            void opCLD(Address);
+            void opSED(Address);
+            void opTYA(Address);
+            void opCLV(Address);
+            void opTXA(Address);
+            void opTXS(Address);
+            void opTAX(Address);
+            void opTSX(Address);
+
+            //Branches
+            void opBPL(Address);
+            void opBMI(Address);
+            void opBVC(Address);
+            void opBVS(Address);
+            void opBCC(Address);
+            void opBCS(Address);
+            void opBNE(Address);
+            void opBEQ(Address);
+            void branch(bool condition);
+
+            //Type 1
+            template <CPUAccuracy accuracy> void opORA(Address location);
+            template <CPUAccuracy accuracy> void opAND(Address location);
+            template <CPUAccuracy accuracy> void opEOR(Address location);
+            template <CPUAccuracy accuracy> void opADC(Address location);
+            template <CPUAccuracy accuracy> void opSTA(Address location);
+            template <CPUAccuracy accuracy> void opLDA(Address location);
+            template <CPUAccuracy accuracy> void opCMP(Address location);
+            template <CPUAccuracy accuracy> void opSBC(Address location);
+
+            //Type 2
+            template <CPUAccuracy accuracy> void opASL(Address location);
+            template <CPUAccuracy accuracy> void opROL(Address location);
+            template <CPUAccuracy accuracy> void opLSR(Address location);
+            template <CPUAccuracy accuracy> void opROR(Address location);
+            void opASLAccumulator(Address);
+            void opROLAccumulator(Address);
+            void opLSRAccumulator(Address);
+            void opRORAccumulator(Address);
+            template <CPUAccuracy accuracy> void opSTX(Address location);
+            template <CPUAccuracy accuracy> void opLDX(Address location);
+            template <CPUAccuracy accuracy> void opDEC(Address location);
+            template <CPUAccuracy accuracy> void opINC(Address location);
 
-            Address readAddress(Address addr);
+            //Type 0
+            template <CPUAccuracy accuracy> void opBIT(Address location);
+            template <CPUAccuracy accuracy> void opSTY(Address location);
+            template <CPUAccuracy accuracy> void opLDY(Address location);
+            template <CPUAccuracy accuracy> void opCPY(Address location);
+            template <CPUAccuracy accuracy> void opCPX(Address location);
 
-            void pushStack(Byte value);
-            Byte pullStack();
+            //Bus accesses of the instructions, timed to their cycle with cycle accuracy
+            template <CPUAccuracy accuracy> Byte read(Address addr);
+            template <CPUAccuracy accuracy> void write(Address addr, Byte value);
+            //Read-modify-write instructions write the unmodified value back before the result
+            template <CPUAccuracy accuracy> void writeModified(Address addr, Byte original, Byte value);
+            void tick();
 
-            //If a and b are in different pages, increases the m_SkipCycles by inc
+            template <CPUAccuracy accuracy> Address readAddress(Address addr);
+            //Fetches the opcode at r_PC and its operand bytes through the bus, advancing r_PC
+            template <CPUAccuracy accuracy> const Instruction& fetchInstruction(Byte& opcode);
+
+            template <CPUAccuracy accuracy> void pushStack(Byte value);
+            template <CPUAccuracy accuracy> Byte pullStack();
+
+            //If a and b are in different pages, increases the m_instructionCycles by inc
             void setPageCrossed(Address a, Address b, int inc = 1);
-            void setZN(Byte value);
 
-            int m_skipCycles;
+            //Flags as laid out in the status register
+            enum StatusFlag
+            {
+                CarryFlag = 0x01,
+                ZeroFlag = 0x02,
+                InterruptFlag = 0x04,
+                DecimalFlag = 0x08,
+                BreakFlag = 0x10,
+                UnusedFlag = 0x20, //always reads as 1
+                OverflowFlag = 0x40,
+                NegativeFlag = 0x80,
+            };
+
+            //N and Z are only evaluated from the last result when they are needed
+            void setZN(Byte value) { m_resultNZ = value; }
+            bool isZero() { return !(m_resultNZ & 0xff); }
+            bool isNegative() { return (m_resultNZ | m_resultNZ >> 8) & 0x80; }
+            //C and V have a bool each, set on their own by most arithmetic. Flags are always constants here,
+            //so the choice of member is resolved when these are inlined
+            bool getFlag(StatusFlag flag)
+            {
+                return flag == CarryFlag ? f_C : flag == OverflowFlag ? f_V : r_P & flag;
+            }
+            void setFlag(StatusFlag flag, bool value)
+            {
+                if (flag == CarryFlag)
+                    f_C = value;
+                else if (flag == OverflowFlag)
+                    f_V = value;
+                else
+                    r_P = value ? r_P | flag : r_P & ~flag;
+            }
+            //The status register, without the B flag
+            Byte getStatus();
+            void setStatus(Byte flags);
+
+            //Cycles taken by the instruction being executed
+            int m_instructionCycles;
+            //The instruction being executed, nullptr during an interrupt sequence
+            const Instruction* m_instruction;
+            //Whether the access in progress is a dummy one, made on the cycle before the access of the operand
+            bool m_dummyAccess;
             int m_cycles;
+            std::uint64_t m_instructionCount;
 
             //Registers
             Address r_PC;
@@ -52,18 +407,48 @@ namespace sn
             Byte r_X;
             Byte r_Y;
 
-            //Status flags.
-            //Is storing them in one byte better ?
+            //I and D flags, as laid out in the status register
+            Byte r_P;
             bool f_C;
-            bool f_Z;
-            bool f_I;
-            bool f_D;
             bool f_V;
-            bool f_N;
+            //Last result setting N and Z. Z is set if the low byte is zero and N is bit 7 of either byte,
+            //so that both can also be set independently (BIT, PLP, RTI)
+            std::uint16_t m_resultNZ;
 
             bool m_pendingNMI;
             bool m_pendingIRQ;
 
+            //Operand bytes of the instruction being executed, little endian
+            Address m_operand;
+
+            //Decoded code of every PRG-ROM bank, indexed by the bank number and filled lazily
+            std::vector<BankBlocks> m_blockCache;
+            //Cache of the banks mapped at 0x8000, 0xa000, 0xc000 and 0xe000; nullptr if not cacheable
+            BankBlocks* m_windowBlocks[4];
+            //Position in the block being executed, valid as long as r_PC == m_blockPC
+            DecodedBlock* m_currentBlock;
+            std::size_t m_blockPosition;
+            Address m_blockPC;
+
+            TranslationMode m_translation;
+            int m_translationBudget;
+
+            CPUAccuracy m_accuracy;
+            std::function<void(void)> m_cycleCallback;
+            //Cycles of the current instruction the cycle callback was run for
+            int m_busCycles;
+
+            CPUTrace* m_trace;
+            CPUProfiler* m_profiler;
+            Watchpoints* m_watchpoints;
+
+            //Idle loop entered last, with the cycle count and the registers at the start of its iteration
+            const DecodedBlock* m_idleBlock;
+            Address m_idlePC;
+            int m_idleStartCycle;
+            RegisterState m_idleState;
+            std::uint64_t m_idleCycles;
+
             MainBus &m_bus;
     };
 
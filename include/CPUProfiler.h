@@ -0,0 +1,64 @@
+#ifndef CPUPROFILER_H
+#define CPUPROFILER_H
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Cartridge.h"
+
+namespace sn
+{
+    //Accumulates the cycles and instructions executed at every PC of every PRG bank, along with the
+    //call stacks they were executed in. Calls are tracked through JSR and interrupts, and a return
+    //unwinds the stack to the frame whose stack pointer it restores, so that RTS used as a jump
+    //(pushing the target and returning to it) doesn't unbalance it
+    class CPUProfiler
+    {
+    public:
+        CPUProfiler();
+
+        //Bank is the PRG-ROM bank mapped at the PC, -1 if it isn't in PRG-ROM
+        void record(int bank, Address pc, int cycles, int instructions = 1);
+        //returnSP is the stack pointer before the call pushed anything
+        void call(int bank, Address target, Byte returnSP);
+        void ret(Byte sp);
+
+        //Locations sorted by the cycles spent on them, at most count of them
+        void writeReport(std::ostream& out, std::size_t count = 100);
+        //One line per call stack with the cycles spent in its innermost function, as read by flamegraph.pl
+        void writeFoldedStacks(std::ostream& out);
+        bool write(const std::string& reportPath, const std::string& stacksPath);
+
+    private:
+        struct Counters
+        {
+            std::uint64_t cycles;
+            std::uint64_t instructions;
+        };
+
+        //A function in a call stack, its callers are found through the parent
+        struct Frame
+        {
+            std::uint32_t function;
+            std::size_t parent;
+            int returnSP;
+            std::uint64_t cycles;
+            std::unordered_map<std::uint32_t, std::size_t> callees;
+        };
+
+        //Bank and address packed in one key, the bank is offset so that -1 maps to 0
+        static std::uint32_t location(int bank, Address pc) { return (bank + 1) << 16 | pc; }
+        static std::string symbol(std::uint32_t location);
+        void writeFoldedStacks(std::ostream& out, std::size_t frame, const std::string& stack);
+
+        std::unordered_map<std::uint32_t, Counters> m_locations;
+        std::uint64_t m_totalCycles;
+
+        //The first frame stands for the code run from reset, outside of any call
+        std::vector<Frame> m_frames;
+        std::size_t m_currentFrame;
+    };
+};
+
+#endif // CPUPROFILER_H
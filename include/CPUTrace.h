@@ -0,0 +1,72 @@
+#ifndef CPUTRACE_H
+#define CPUTRACE_H
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Cartridge.h"
+
+namespace sn
+{
+    //State of the CPU before it executes an instruction
+    struct TraceRecord
+    {
+        std::uint64_t cycle;
+        std::uint32_t frame;
+        Address pc;
+        Byte opcode;
+        Byte a;
+        Byte x;
+        Byte y;
+        Byte p;
+        Byte sp;
+        //Always zero. Fills what would otherwise be padding, so that the records are written out as they are
+        //and the same run gives the same trace file
+        Byte reserved[4];
+    };
+    static_assert(sizeof(TraceRecord) == 24, "TraceRecord must not have any padding");
+
+    //Records the executed instructions in binary, without any formatting.
+    //The records are collected in a fixed-size buffer, which is written out to the trace file and emptied
+    //every time it fills up. Text is only rendered offline, by decode()
+    class CPUTrace
+    {
+    public:
+        CPUTrace(std::size_t capacity = DefaultCapacity);
+        ~CPUTrace();
+        bool open(const std::string& path);
+        bool isOpen() { return m_file.is_open(); }
+
+        //Only instructions at PCs in [first, last] are recorded
+        void setPCRange(Address first, Address last);
+        //Only instructions executed during the frames in [first, last] are recorded
+        void setFrameRange(std::uint32_t first, std::uint32_t last);
+        //Returns the number of the frame being rendered
+        void setFrameCallback(std::function<std::uint32_t(void)> callback);
+
+        //The frame of the record is filled in here
+        void record(TraceRecord record);
+        //Writes the buffered records to the file
+        void flush();
+
+        //Renders a binary trace in the Nintendulator style, one instruction per line
+        static bool decode(const std::string& path, std::ostream& out);
+        static void format(const TraceRecord& record, std::ostream& out);
+
+        static const std::size_t DefaultCapacity = 0x10000;
+    private:
+        std::vector<TraceRecord> m_buffer;
+        std::size_t m_size;
+
+        Address m_firstPC;
+        Address m_lastPC;
+        std::uint32_t m_firstFrame;
+        std::uint32_t m_lastFrame;
+        std::function<std::uint32_t(void)> m_frameCallback;
+
+        std::ofstream m_file;
+    };
+};
+
+#endif // CPUTRACE_H
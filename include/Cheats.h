@@ -0,0 +1,47 @@
+#ifndef CHEATS_H
+#define CHEATS_H
+#include <string>
+#include <vector>
+#include "Cartridge.h"
+
+namespace sn
+{
+    //Game Genie codes and raw patches of the CPU's reads of RAM and PRG-ROM. A patch replaces the value
+    //read at its address, or only a given value if it has a compare. Like with the Game Genie, nothing is
+    //written to memory. MainBus only intercepts the reads of the pages that have a patch
+    class Cheats
+    {
+    public:
+        //Game Genie code of 6 or 8 letters, "addr=value" or "addr?compare=value" in hex.
+        //Returns false if it can't be parsed
+        bool add(const std::string& code);
+        //One code per line, anything after it on the line is ignored. Blank lines and those starting with '#'
+        //are skipped. Returns false if the file can't be read
+        bool loadFromFile(const std::string& path);
+        void clear() { m_patches.clear(); }
+        bool empty() { return m_patches.empty(); }
+
+        //Whether any address in [first, last] is patched
+        bool patches(Address first, Address last);
+        //Value read at addr, given the one in memory
+        Byte apply(Address addr, Byte value);
+
+        //The cheats of a ROM are in a file next to it, of the same name with the .cht extension
+        static std::string getPath(const std::string& rom_path);
+    private:
+        struct Patch
+        {
+            Address addr;
+            Byte value;
+            int compare; //-1 if any value is replaced
+        };
+        static bool decodeGameGenie(const std::string& code, Patch& patch);
+        static bool decodeRaw(const std::string& code, Patch& patch);
+        //Internal RAM is patched in all of its mirrors
+        static Address normalize(Address addr) { return addr < 0x2000 ? addr & 0x7ff : addr; }
+
+        std::vector<Patch> m_patches;
+    };
+};
+
+#endif // CHEATS_H
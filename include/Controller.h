@@ -1,8 +1,7 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
-#include <SFML/Window.hpp>
 #include <cstdint>
-#include <vector>
+#include "Snapshot.h"
 
 namespace sn
 {
@@ -26,13 +25,15 @@ namespace sn
 
         void strobe(Byte b);
         Byte read();
-        void setKeyBindings(const std::vector<sf::Keyboard::Key>& keys);
+        //Buttons held down, one bit for each in the order of Buttons
+        void setButtons(Byte buttons);
+
+        void saveState(Snapshot& snapshot);
+        void loadState(Snapshot& snapshot);
     private:
         bool m_strobe;
+        Byte m_buttons;
         unsigned int m_keyStates;
-
-        std::vector<sf::Keyboard::Key> m_keyBindings;
-//         sf::Keyboard::Key m_keyBindings[TotalButtons];
     };
 }
 
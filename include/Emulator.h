@@ -1,50 +1,91 @@
 #ifndef EMULATOR_H
 #define EMULATOR_H
 #include <SFML/Graphics.hpp>
-#include <chrono>
+#include <atomic>
+#include <thread>
 
-#include "CPU.h"
-#include "PPU.h"
-#include "MainBus.h"
-#include "PictureBus.h"
-#include "Controller.h"
+#include "EmulatorCore.h"
+#include "FramePacer.h"
+#include "TripleBuffer.h"
+#include "VirtualScreen.h"
 
 namespace sn
 {
-    using TimePoint = std::chrono::high_resolution_clock::time_point;
-
     const int NESVideoWidth = ScanlineVisibleDots;
     const int NESVideoHeight = VisibleScanlines;
 
+    //Window, keyboard and real time clock around the EmulatorCore.
+    //While running, the core is emulated on a thread of its own. The window's thread only handles the events,
+    //samples the keyboard into m_buttons and shows the frames the emulation thread publishes in m_frames
     class Emulator
     {
     public:
         Emulator();
         void run(std::string rom_path);
+        //Runs the given number of frames without a window and reports the emulation speed
+        void benchmark(std::string rom_path, int frames);
+        //Runs the given number of frames without a window, along with a cycle accurate core it is compared to
+        //at the end of each of them. Returns false at the first frame they differ at
+        bool verifyAccuracy(std::string rom_path, int frames);
         void setVideoWidth(int width);
         void setVideoHeight(int height);
         void setVideoScale(float scale);
+        void setTranslation(TranslationMode mode);
+        void setAccuracy(CPUAccuracy accuracy);
+        void setCPUTrace(CPUTrace* trace);
+        void setCPUProfiler(CPUProfiler* profiler);
+        //A hit pauses the emulation, until it is unpaused with F2
+        void setWatchpoints(Watchpoints* watchpoints);
+        //Runs as fast as the host allows, showing the frames at the display rate. Toggled with Tab
+        void setFastForward(bool fastForward);
+        //Frames run ahead of the one shown, to hide the game's own input lag. See EmulatorCore::runFrameAhead
+        void setRunAhead(int frames);
         void setKeys(std::vector<sf::Keyboard::Key>& p1, std::vector<sf::Keyboard::Key>& p2);
     private:
-        void DMA(Byte page);
+        //Buttons of the controller held down on the keyboard, one bit for each of Controller::Buttons
+        Byte readKeys(const std::vector<sf::Keyboard::Key>& keys);
+        void updateScreen(const Framebuffer& picture);
+
+        //Emulation thread
+        void emulate();
+        //Runs the frames that are due and publishes the last one, run ahead
+        void runFrames(int frames);
+        //Runs frames until the next one is to be shown, then publishes it
+        void fastForward();
+        //Frames that aren't shown are left undrawn. Returns false if the frame was stopped by a watchpoint hit
+        bool runFrame(bool render, int runAhead = 0);
+        void publish();
+        //Restarts the clocks after the emulation was stopped
+        void resume();
+        //Logs the speed of fast-forward since it was last reported
+        void reportSpeed();
+
+        EmulatorCore m_core;
+        std::vector<sf::Keyboard::Key> m_keys1, m_keys2;
 
-        MainBus m_bus;
-        PictureBus m_pictureBus;
-        CPU m_cpu;
-        PPU m_ppu;
-        Cartridge m_cartridge;
-        std::unique_ptr<Mapper> m_mapper;
+        std::thread m_emulationThread;
+        TripleBuffer<Framebuffer> m_frames;
+        //Both controllers, the first in the low byte
+        std::atomic<std::uint16_t> m_buttons;
+        std::atomic<bool> m_running;
+        std::atomic<bool> m_paused;
+        std::atomic<bool> m_fastForward;
+        //Set by the emulation thread when it stops at a watchpoint hit, cleared when unpaused
+        std::atomic<bool> m_break;
+        //Frames to run while paused
+        std::atomic<int> m_framesToStep;
+        //Last speed multiplier measured in fast-forward, for the title
+        std::atomic<float> m_fastForwardSpeed;
+        int m_runAhead;
 
-        Controller m_controller1, m_controller2;
+        FramePacer m_pacer;
+        //Frames run and time taken by fast-forward since its speed was last reported
+        std::uint64_t m_fastForwardFrames;
+        FramePacer::Clock::time_point m_fastForwardStart;
 
         sf::RenderWindow m_window;
         VirtualScreen m_emulatorScreen;
         float m_screenScale;
-
-        TimePoint m_cycleTimer;
-
-        std::chrono::high_resolution_clock::duration m_elapsedTime;
-        std::chrono::nanoseconds m_cpuCycleDuration;
     };
 }
 #endif // EMULATOR_H
@@ -0,0 +1,106 @@
+#ifndef EMULATORCORE_H
+#define EMULATORCORE_H
+#include <memory>
+#include <string>
+
+#include "CPU.h"
+#include "PPU.h"
+#include "MainBus.h"
+#include "PictureBus.h"
+#include "Controller.h"
+#include "Scheduler.h"
+#include "Snapshot.h"
+
+namespace sn
+{
+    const int CPUCyclesPerFrame = 29781;
+
+    //The console on its own, without a window, a keyboard or a clock. It only runs when it's told to,
+    //so it can be driven as fast as the caller likes
+    class EmulatorCore
+    {
+    public:
+        EmulatorCore();
+        bool loadRom(const std::string& rom_path);
+        //Runs until the picture of the next frame is complete, with the given buttons held down
+        //(one bit for each of Controller::Buttons) for the whole frame. Unless render is set the picture
+        //is left undrawn, which changes nothing else.
+        //A watchpoint hit stops it after the instruction that hit it, the next call carries on with the frame
+        void runFrame(Byte buttons1, Byte buttons2, bool render = true);
+        //Runs a frame, then the given number of frames past it with the same buttons, so that the picture
+        //shows their effect that many frames earlier. The console is put back to the end of the first frame
+        //afterwards, only the last frame run is drawn. Nothing is run ahead with watchpoints, their hits
+        //would be undone
+        void runFrameAhead(Byte buttons1, Byte buttons2, int frames);
+        //Runs the CPU and the PPU until the master clock reaches the given time, or just past it,
+        //unless a watchpoint is hit before
+        void runUntil(Timestamp time);
+        //Whether the last run was stopped by a watchpoint hit
+        bool isStopped() { return m_stopped; }
+        //Picture of the last frame completed
+        const Framebuffer& framebuffer() { return m_ppu.getFramebuffer(); }
+        //FNV-1a hash of the colors of the last frame completed, so that pictures can be compared across runs
+        std::uint64_t getFrameHash();
+
+        void setButtons(Byte buttons1, Byte buttons2);
+
+        //State of the whole console, between two instructions. See Snapshot for its limits
+        void saveState(Snapshot& snapshot);
+        void loadState(Snapshot& snapshot);
+        //Whether the CPU, internal RAM, the time and the last picture are the same as in the other core, which
+        //runs the same ROM with other settings. How the two got there, cached or skipped, isn't compared
+        bool isInSameState(EmulatorCore& other);
+
+        Timestamp getTime() { return m_scheduler.getTime(); }
+        std::uint64_t getInstructionCount() { return m_cpu.getInstructionCount(); }
+        std::uint64_t getIdleCycles() { return m_cpu.getIdleCycles(); }
+        Mapper::Type getMapperType() { return m_mapper->getType(); }
+
+        void setTranslation(TranslationMode mode);
+        void setAccuracy(CPUAccuracy accuracy);
+        void setCPUTrace(CPUTrace* trace);
+        void setCPUProfiler(CPUProfiler* profiler);
+        //Every hit is logged with the CPU state. nullptr removes them all
+        void setWatchpoints(Watchpoints* watchpoints);
+    private:
+        //Executes one CPU instruction with the matching PPU dots, or skips the iterations of an idle loop
+        //up to the next event without going past limit. Returns the CPU cycles taken
+        int stepInstruction(Timestamp limit);
+        //Runs the PPU up to the given time. It is only caught up when something could tell it lags behind
+        void syncPPU(Timestamp time);
+        //Runs the PPU up to the cycle of the CPU's bus access in progress, the one the access sees it at
+        void syncPPUForAccess(bool write);
+        void updatePPUDeadline();
+
+        //Handlers of the I/O registers
+        template <Byte (PPU::*read)()>
+        Byte readPPU();
+        template <void (PPU::*write)(Byte)>
+        void writePPU(Byte value);
+        void strobeControllers(Byte value);
+        void DMA(Byte page);
+
+        MainBus m_bus;
+        PictureBus m_pictureBus;
+        CPU m_cpu;
+        PPU m_ppu;
+        Cartridge m_cartridge;
+        std::unique_ptr<Mapper> m_mapper;
+        //Of the ROM loaded, see Cheats::getPath
+        Cheats m_cheats;
+
+        Controller m_controller1, m_controller2;
+
+        Scheduler m_scheduler;
+        //Time the PPU has been run up to, and the time it may interrupt the CPU at the earliest
+        Timestamp m_ppuTime;
+        Timestamp m_ppuDeadline;
+        bool m_frameComplete;
+        Watchpoints* m_watchpoints;
+        bool m_stopped;
+
+        //State to go back to after running ahead
+        Snapshot m_runAheadState;
+    };
+}
+#endif // EMULATORCORE_H
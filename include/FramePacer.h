@@ -0,0 +1,48 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+#include <chrono>
+#include <cstdint>
+#include "Log.h"
+
+namespace sn
+{
+    const double NTSCFrameRate = 60.0988;
+
+    //Schedules whole frames at a fixed rate. The time of every frame is counted from the start of the schedule,
+    //so rounding never adds up to drift, and after a stall only a few frames are made up for, the rest are dropped
+    class FramePacer
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        FramePacer(double frameRate = NTSCFrameRate);
+        //Starts the schedule over from now, after a pause
+        void reset();
+        //Number of frames to emulate to get back on schedule, at most MaxCatchUpFrames
+        int framesDue();
+        //Sleeps until the next frame is due
+        void waitForNextFrame();
+
+        //Logs how late the frames were woken up and how many were dropped, then starts counting again.
+        //This is done on its own every StatsInterval frames, at InfoVerbose
+        void logStats(Level level = Info);
+
+        static const int MaxCatchUpFrames = 3;
+        static const int StatsInterval = 600;
+    private:
+        Clock::time_point frameTime(std::uint64_t frame);
+
+        double m_frameRate;
+        Clock::time_point m_start;
+        //Frames run since the start of the schedule
+        std::uint64_t m_frame;
+
+        //Lateness of the frames since the last report
+        std::uint64_t m_wakeups;
+        Clock::duration m_totalLateness;
+        Clock::duration m_maxLateness;
+        std::uint64_t m_droppedFrames;
+    };
+}
+
+#endif // FRAMEPACER_H
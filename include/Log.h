@@ -2,8 +2,11 @@
 #define LOG_H
 #include <iostream>
 #include <string>
+#include <sstream>
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <atomic>
 #include <cstring>
 
 #ifndef __FILENAME__
@@ -12,11 +15,7 @@
 
 #define LOG(level) \
 if (level > sn::Log::get().getLevel()) ; \
-else sn::Log::get().getStream() << '[' << __FILENAME__ << ":" << std::dec << __LINE__ << "] "
-
-#define LOG_CPU \
-if (sn::CpuTrace != sn::Log::get().getLevel()) ; \
-else sn::Log::get().getCpuTraceStream()
+else sn::Log::Line().getStream() << '[' << __FILENAME__ << ":" << std::dec << __LINE__ << "] "
 
 namespace sn
 {
@@ -26,25 +25,35 @@ namespace sn
         Error,
         Info,
         InfoVerbose,
-        CpuTrace
     };
+    //Used from both the emulation and the window thread. Every message is put together on its own and
+    //written out whole, under a lock, so that messages of the two threads don't interleave
     class Log
     {
     public:
+        //One message, written out to the log stream when it is destroyed at the end of the LOG statement
+        class Line
+        {
+        public:
+            ~Line();
+            std::ostream& getStream() { return m_buffer; }
+        private:
+            std::ostringstream m_buffer;
+        };
+
         ~Log();
         void setLogStream(std::ostream& stream);
-        void setCpuTraceStream(std::ostream& stream);
         Log& setLevel(Level level);
         Level getLevel();
 
-        std::ostream& getStream();
-        std::ostream& getCpuTraceStream();
+        //Writes a whole message and flushes the stream
+        void write(const std::string& message);
 
         static Log& get();
     private:
-        Level m_logLevel;
+        std::atomic<Level> m_logLevel;
         std::ostream* m_logStream;
-        std::ostream* m_cpuTrace;
+        std::mutex m_mutex;
     };
 
     //Courtesy of http://wordaligned.org/articles/cpp-streambufs#toctee-streams
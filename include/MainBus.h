@@ -1,11 +1,14 @@
 #ifndef MEMORY_H
 #define MEMORY_H
+#include <array>
 #include <vector>
-#include <unordered_map>
 #include <functional>
 #include <memory>
 #include "Cartridge.h"
+#include "Cheats.h"
 #include "Mapper.h"
+#include "Snapshot.h"
+#include "Watchpoints.h"
 
 namespace sn
 {
@@ -23,31 +26,135 @@ namespace sn
         JOY1 = 0x4016,
         JOY2 = 0x4017,
     };
-    struct IORegistersHasher
-    {
-        std::size_t operator()(sn::IORegisters const & reg) const noexcept
-        {
-            return std::hash<std::uint32_t>{}(reg);
-        }
-    };
+    //PPU registers come first, then those from OAMDMA on
+    const int IORegisterCount = 8 + JOY2 - OAMDMA + 1;
 
     class MainBus
     {
         public:
             MainBus();
-            Byte read(Address addr);
-            void write(Address addr, Byte value);
+            //Memory is accessed straight through the page table, the rest through the handler of its page
+            Byte read(Address addr)
+            {
+                const Byte* page = m_readPages[addr >> 8];
+                if (page)
+                    return page[addr & 0xff];
+                return readHandler(addr);
+            }
+            void write(Address addr, Byte value)
+            {
+                Byte* page = m_writePages[addr >> 8];
+                if (page)
+                    page[addr & 0xff] = value;
+                else
+                    writeHandler(addr, value);
+            }
+            //Reads memory as the CPU sees it, cheats included, without the handlers or the watchpoints.
+            //For looking at code ahead of its execution, registers read as 0
+            Byte peek(Address addr);
             bool setMapper(Mapper* mapper);
-            bool setWriteCallback(IORegisters reg, std::function<void(Byte)> callback);
-            bool setReadCallback(IORegisters reg, std::function<Byte(void)> callback);
+            //Must be called when the mapper switches the PRG-ROM banks visible to the CPU
+            void updatePRGPages();
+            //Binds the register to a member function of the given object. The function is a template argument,
+            //so the handler calls it directly and it can be inlined into it. Fails if the register is already bound
+            template <typename T, Byte (T::*read)()>
+            bool setReadHandler(IORegisters reg, T* object)
+            {
+                return setReadHandler(reg, {[](void* o) { return (static_cast<T*>(o)->*read)(); }, object});
+            }
+            template <typename T, void (T::*write)(Byte)>
+            bool setWriteHandler(IORegisters reg, T* object)
+            {
+                return setWriteHandler(reg, {[](void* o, Byte value) { (static_cast<T*>(o)->*write)(value); }, object});
+            }
+            //Called before every write to the mapper, which may switch the CHR banks or the mirroring under the PPU
+            void setMapperWriteCallback(std::function<void(void)> callback);
             const Byte* getPagePtr(Byte page);
+            //Location of addr in the internal RAM, nullptr if addr is not mapped to it
+            Byte* getRAMPtr(Address addr);
+            //Index of the PRG-ROM bank mapped at addr, -1 if the address is not backed by PRG-ROM
+            int getPRGBank(Address addr);
+            //Accesses to the pages with a read or write watchpoint are taken off the page table, to be
+            //checked by the handlers. nullptr removes them all
+            void setWatchpoints(Watchpoints* watchpoints);
+            //Same for the reads of the pages with a cheat, which are patched by the handlers
+            void setCheats(Cheats* cheats);
+            //Whether a cheat patches the reads of an address in [first, last], at most a page apart.
+            //Memory that is not read through the bus doesn't see the cheats
+            bool isPatched(Address first, Address last)
+            {
+                return (m_cheatPages[first >> 8] || m_cheatPages[last >> 8]) && m_cheats->patches(first, last);
+            }
+            //Accesses that went through the page handlers, those to anything but memory and to watched or
+            //patched pages, since power on
+            std::uint64_t getHandlerAccesses() { return m_handlerAccesses; }
+
+            //Internal and extended RAM
+            void saveState(Snapshot& snapshot);
+            void loadState(Snapshot& snapshot);
         private:
+            struct ReadHandler
+            {
+                Byte (*read)(void* object);
+                void* object;
+            };
+            struct WriteHandler
+            {
+                void (*write)(void* object, Byte value);
+                void* object;
+            };
+            bool setReadHandler(IORegisters reg, ReadHandler handler);
+            bool setWriteHandler(IORegisters reg, WriteHandler handler);
+            //Index of the register in the handler tables
+            static int registerIndex(Address addr) { return addr < OAMDMA ? addr & 0x7 : 8 + addr - OAMDMA; }
+
+            //What takes care of the accesses to a page that aren't done through its pointer
+            enum PageHandler
+            {
+                MemoryHandler,      //none, the page is memory for both reads and writes, unless watched
+                PPUHandler,         //PPU registers, mirrored every 8 bytes
+                IOHandler,          //APU and I/O registers, then the start of the expansion area
+                ExpansionHandler,   //expansion ROM, unsupported
+                UnmappedHandler,    //nothing, reads as 0
+                MapperHandler,      //reads of PRG-ROM not backed by it and all writes, to the mapper
+            };
+
+            //Checks the watchpoints of the page around the access by its handler
+            Byte readHandler(Address addr);
+            void writeHandler(Address addr, Byte value);
+            Byte readPage(Address addr);
+            Byte patch(Address addr, Byte value) { return m_cheatPages[addr >> 8] ? m_cheats->apply(addr, value) : value; }
+            //Reads of the page go through readHandler
+            bool isReadIntercepted(int page) { return (m_watchedPages[page] & WatchRead) || m_cheatPages[page]; }
+            void writePage(Address addr, Byte value);
+            //Location of addr in the internal or extended RAM, for the pages of MemoryHandler
+            Byte* memoryLocation(Address addr);
+            //Maps the given range of pages, both ends included. Watched pages are left to the handler
+            void mapPages(int first, int last, Byte* memory, std::size_t mirrorSize, PageHandler handler);
+            //Maps the whole address space for the mapper
+            void mapMemory();
+
+            //One entry for each 256-byte page of the address space, pointing at the start of the page.
+            //nullptr if the access has to go through the page's handler
+            std::array<const Byte*, 0x100> m_readPages;
+            std::array<Byte*, 0x100> m_writePages;
+            std::array<PageHandler, 0x100> m_pageHandlers;
+            //Types of access watched in each page, see WatchType
+            std::array<Byte, 0x100> m_watchedPages;
+            Watchpoints* m_watchpoints;
+            //Whether each page has a cheat
+            std::array<bool, 0x100> m_cheatPages;
+            Cheats* m_cheats;
+            std::uint64_t m_handlerAccesses;
+
             std::vector<Byte> m_RAM;
             std::vector<Byte> m_extRAM;
             Mapper* m_mapper;
 
-            std::unordered_map<IORegisters, std::function<void(Byte)>, IORegistersHasher> m_writeCallbacks;
-            std::unordered_map<IORegisters, std::function<Byte(void)>, IORegistersHasher> m_readCallbacks;;
+            //Handlers of the I/O registers, not set if read is nullptr
+            std::array<ReadHandler, IORegisterCount> m_readHandlers;
+            std::array<WriteHandler, IORegisterCount> m_writeHandlers;
+            std::function<void(void)> m_mapperWriteCallback;
     };
 };
 
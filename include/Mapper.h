@@ -2,6 +2,8 @@
 #define MAPPER_H
 #include "CPUOpcodes.h"
 #include "Cartridge.h"
+#include "Snapshot.h"
+#include <array>
 #include <memory>
 #include <functional>
 
@@ -32,28 +34,109 @@ namespace sn
                 GxROM = 66,
             };
 
-            Mapper(Cartridge& cart, Type t) : m_cartridge(cart), m_type(t) {};
+            Mapper(Cartridge& cart, Type t);
             virtual ~Mapper() = default;
             virtual void writePRG (Address addr, Byte value) = 0;
-            virtual Byte readPRG (Address addr) = 0;
-
-            virtual Byte readCHR (Address addr) = 0;
             virtual void writeCHR (Address addr, Byte value) = 0;
 
+            //Reads go through the bank windows the mapper published, it is only involved when they are switched.
+            //Addresses not mapped to anything read as 0
+            Byte readPRG (Address addr)
+            {
+                const Byte* bank = getPRGPointer(addr);
+                return bank ? *bank : 0;
+            }
+            Byte readCHR (Address addr)
+            {
+                const Byte* bank = getCHRPointer(addr);
+                return bank ? *bank : 0;
+            }
+
             virtual NameTableMirroring getNameTableMirroring();
 
+            //Location in PRG-ROM of the given CPU address, nullptr if it isn't backed by it
+            const Byte* getPRGPointer(Address addr)
+            {
+                const Byte* window = addr >= 0x8000 ? m_prgWindows[(addr >> 13) & 0x3] : nullptr;
+                return window ? window + (addr & 0x1fff) : nullptr;
+            }
+            //Index of the 8KB PRG-ROM bank that is mapped at the given CPU address, -1 if it isn't backed by it
+            int getPRGBank(Address addr)
+            {
+                const Byte* bank = getPRGPointer(addr);
+                return bank ? static_cast<int>((bank - m_cartridge.getROM().data()) / 0x2000) : -1;
+            }
+
+            //Called every time the PRG-ROM banks mapped in CPU address space change
+            void setPRGBankCallback(std::function<void(void)> cb)
+            {
+                m_prgBankCallback = cb;
+            }
+
+            //Location of the given PPU address (below 0x3000) in CHR memory or the mapper's own name tables,
+            //nullptr if it isn't backed by either
+            const Byte* getCHRPointer(Address addr)
+            {
+                const Byte* window = addr < 0x3000 ? m_chrWindows[addr >> 10] : nullptr;
+                return window ? window + (addr & 0x3ff) : nullptr;
+            }
+
+            //Called every time the CHR banks mapped in PPU address space change
+            void setCHRBankCallback(std::function<void(void)> cb)
+            {
+                m_chrBankCallback = cb;
+            }
+
             bool inline hasExtendedRAM()
             {
                 return m_cartridge.hasExtendedRAM();
             }
 
             virtual void scanlineIRQ(){}
+            //Whether scanlineIRQ() may interrupt the CPU, so the PPU has to be run in time for it.
+            //It must not change for the mapper, scanlineIRQ() isn't called at all unless it is set
+            virtual bool hasScanlineIRQ() { return false; }
+
+            Type getType() { return m_type; }
+
+            //Bank registers and the RAM on the cartridge. The buses and the CPU keep what they derived from them,
+            //like the mirroring and the banks mapped, in their own state.
+            //Mappers save the bank windows along with their own state by calling these first
+            virtual void saveState(Snapshot& snapshot);
+            virtual void loadState(Snapshot& snapshot);
 
             static std::unique_ptr<Mapper> createMapper (Type mapper_t, Cartridge& cart, std::function<void()> interrupt_cb, std::function<void(void)> mirroring_cb);
 
         protected:
+            void prgBanksChanged()
+            {
+                if (m_prgBankCallback)
+                    m_prgBankCallback();
+            }
+
+            void chrBanksChanged()
+            {
+                if (m_chrBankCallback)
+                    m_chrBankCallback();
+            }
+
+            //Publish the banks mapped in size bytes from addr on, then prgBanksChanged() and chrBanksChanged()
+            //tell the buses once all the windows are set. Offsets past the end of the ROM wrap around to its start,
+            //as if its upper address lines weren't connected
+            void mapPRG(Address addr, std::size_t size, std::size_t offset);
+            void mapCHRROM(Address addr, std::size_t size, std::size_t offset);
+            //Maps CHR-RAM or the mapper's own name table RAM (0x2000-0x2fff)
+            void mapCHR(Address addr, std::size_t size, const Byte* memory);
+
             Cartridge& m_cartridge;
             Type m_type;
+            std::function<void(void)> m_prgBankCallback;
+            std::function<void(void)> m_chrBankCallback;
+
+            //Start of what is mapped in each 8KB window of 0x8000-0xffff and each 1KB window of 0x0000-0x2fff,
+            //nullptr if nothing is
+            std::array<const Byte*, 4> m_prgWindows;
+            std::array<const Byte*, 12> m_chrWindows;
     };
 }
 
@@ -9,13 +9,13 @@ namespace sn
         MapperAxROM(Cartridge &cart, std::function<void(void)> mirroring_cb);
 
         void writePRG(Address address, Byte value);
-        Byte readPRG(Address address);
-
-        Byte readCHR(Address address);
         void writeCHR(Address address, Byte value);
 
         NameTableMirroring getNameTableMirroring();
 
+        void saveState(Snapshot& snapshot);
+        void loadState(Snapshot& snapshot);
+
     private:
         NameTableMirroring m_mirroring;
 
@@ -9,13 +9,12 @@ namespace sn
         public:
             MapperCNROM(Cartridge& cart);
             void writePRG (Address addr, Byte value);
-            Byte readPRG (Address addr);
-
-            Byte readCHR (Address addr);
             void writeCHR (Address addr, Byte value);
-        private:
-            bool m_oneBank;
 
+            void saveState(Snapshot& snapshot);
+            void loadState(Snapshot& snapshot);
+
+        private:
             Address m_selectCHR;
     };
 }
@@ -11,11 +11,11 @@ namespace sn
         MapperColorDreams(Cartridge &cart, std::function<void(void)> mirroring_cb);
         NameTableMirroring getNameTableMirroring();
         void writePRG(Address address, Byte value);
-        Byte readPRG(Address address);
-
-        Byte readCHR(Address address);
         void writeCHR(Address address, Byte value);
 
+        void saveState(Snapshot& snapshot);
+        void loadState(Snapshot& snapshot);
+
     private:
         NameTableMirroring m_mirroring;
         uint32_t prgbank;
@@ -8,13 +8,12 @@ namespace sn
         MapperGxROM(Cartridge &cart, std::function<void(void)> mirroring_cb);
         NameTableMirroring getNameTableMirroring();
         void writePRG(Address address, Byte value);
-        Byte readPRG(Address address);
-
-        Byte readCHR(Address address);
         void writeCHR(Address address, Byte value);
         Byte prgbank;
         Byte chrbank;
 
+        void saveState(Snapshot& snapshot);
+        void loadState(Snapshot& snapshot);
 
     private:
         NameTableMirroring m_mirroring;
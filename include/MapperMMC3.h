@@ -10,14 +10,16 @@ namespace sn
   public:
     MapperMMC3(Cartridge &cart, std::function<void()> interrupt_cb, std::function<void(void)> mirroring_cb);
 
-    Byte readPRG(Address addr);
     void writePRG(Address addr, Byte value);
 
     NameTableMirroring getNameTableMirroring();
-    Byte readCHR(Address addr);
     void writeCHR(Address addr, Byte value);
 
     void scanlineIRQ();
+    bool hasScanlineIRQ() { return true; }
+
+    void saveState(Snapshot& snapshot);
+    void loadState(Snapshot& snapshot);
 
   private:
     // Control variables
@@ -34,12 +36,6 @@ namespace sn
 
     std::vector<Byte> m_prgRam;
     std::vector<Byte> m_mirroringRam;
-    const Byte *m_prgBank0;
-    const Byte *m_prgBank1;
-    const Byte *m_prgBank2;
-    const Byte *m_prgBank3;
-
-    std::array<uint32_t, 8> m_chrBanks;
 
     NameTableMirroring m_mirroring;
     std::function<void(void)> m_mirroringCallback;
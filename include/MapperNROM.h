@@ -9,12 +9,12 @@ namespace sn
         public:
             MapperNROM(Cartridge& cart);
             void writePRG (Address addr, Byte value);
-            Byte readPRG (Address addr);
-
-            Byte readCHR (Address addr);
             void writeCHR (Address addr, Byte value);
+
+            void saveState(Snapshot& snapshot);
+            void loadState(Snapshot& snapshot);
+
         private:
-            bool m_oneBank;
             bool m_usesCharacterRAM;
 
             std::vector<Byte> m_characterRAM;
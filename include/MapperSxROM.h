@@ -9,14 +9,17 @@ namespace sn
         public:
             MapperSxROM(Cartridge& cart, std::function<void(void)> mirroring_cb);
             void writePRG (Address addr, Byte value);
-            Byte readPRG (Address addr);
-
-            Byte readCHR (Address addr);
             void writeCHR (Address addr, Byte value);
 
             NameTableMirroring getNameTableMirroring();
+
+            void saveState(Snapshot& snapshot);
+            void loadState(Snapshot& snapshot);
+
         private:
-            void calculatePRGPointers();
+            void calculatePRGBanks();
+            //Maps CHR-ROM banks, CHR-RAM isn't switched
+            void mapCHRBanks(Address addr, std::size_t size, std::size_t offset);
 
             std::function<void(void)> m_mirroringCallback;
             NameTableMirroring m_mirroing;
@@ -32,12 +35,6 @@ namespace sn
             Byte m_regCHR0;
             Byte m_regCHR1;
 
-            const Byte* m_firstBankPRG;
-            const Byte* m_secondBankPRG;
-
-            const Byte* m_firstBankCHR;
-            const Byte* m_secondBankCHR;
-
             std::vector<Byte> m_characterRAM;
     };
 }
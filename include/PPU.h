@@ -4,8 +4,9 @@
 #include <array>
 #include "PictureBus.h"
 #include "MainBus.h"
-#include "VirtualScreen.h"
 #include "PaletteColors.h"
+#include "Snapshot.h"
+#include <SFML/Graphics.hpp>
 
 namespace sn
 {
@@ -17,17 +18,43 @@ namespace sn
 
     const int AttributeOffset = 0x3C0;
 
+    //Colors of the visible dots of a frame, row by row
+    using Framebuffer = std::vector<sf::Color>;
+
     class PPU
     {
         public:
-            PPU(PictureBus &bus, VirtualScreen &screen);
+            PPU(PictureBus &bus);
             void step();
+            //Runs the given number of dots
+            void run(int dots);
             void reset();
 
+            //Number of dots that can be run before PPUSTATUS, the NMI or the mapper's scanline counter may change
+            int getEventHorizon();
+            //Number of dots that can be run before the PPU may interrupt the CPU, at least up to the vertical blank
+            //when nothing interrupts on the scanlines, so that a PPU left alone is only caught up about once a frame
+            int getInterruptHorizon();
+            //Whether PPUSTATUS would read the same as the last time it was read
+            bool isStatusUnchanged();
+            //Frames completed since reset
+            std::uint32_t getFrame() { return m_frame; }
+            //Picture of the last frame completed
+            const Framebuffer& getFramebuffer() { return m_framebuffer; }
+            //Leaves the picture undrawn, for frames that aren't shown. Only what the CPU can observe is kept up:
+            //the sprite-0 hit, sprite overflow, the vertical blank and the mapper's scanline counter
+            void setRenderSkip(bool skip) { m_renderSkip = skip; }
+
             void setInterruptCallback(std::function<void(void)> cb);
+            //Called when the picture of a frame is complete, right before the vertical blank
+            void setFrameCallback(std::function<void(void)> cb);
 
             void doDMA(const Byte* page_ptr);
 
+            //The last completed picture is left out, it stays shown until the next frame is complete
+            void saveState(Snapshot& snapshot);
+            void loadState(Snapshot& snapshot);
+
             //Callbacks mapped to CPU address space
             //Addresses written to by the program
             void control(Byte ctrl);
@@ -42,13 +69,19 @@ namespace sn
             Byte getOAMData();
             void setOAMData(Byte value);
         private:
+            //Computes the color of a visible dot of the current scanline
+            void renderDot(int x);
+            void incrementCoarseX();
+            //Whether sprite 0 covers the dot while a hit can still be detected
+            bool maySetSpriteZeroHit(int x);
+            Byte statusFlags();
             Byte readOAM(Byte addr);
             void writeOAM(Byte addr, Byte value);
             Byte read(Address addr);
             PictureBus &m_bus;
-            VirtualScreen &m_screen;
 
             std::function<void(void)> m_vblankCallback;
+            std::function<void(void)> m_frameCallback;
 
             std::vector<Byte> m_spriteMemory;
 
@@ -64,10 +97,12 @@ namespace sn
             int m_cycle;
             int m_scanline;
             bool m_evenFrame;
+            std::uint32_t m_frame;
 
             bool m_vblank;
             bool m_sprZeroHit;
             bool m_spriteOverflow;
+            Byte m_lastStatus;
 
             //Registers
             Address m_dataAddress;
@@ -97,7 +132,10 @@ namespace sn
 
             Address m_dataAddrIncrement;
 
-            std::vector<std::vector<sf::Color>> m_pictureBuffer;
+            //The frame being drawn, swapped with the completed one at its end
+            Framebuffer m_pictureBuffer;
+            Framebuffer m_framebuffer;
+            bool m_renderSkip;
     };
 }
 
@@ -1,8 +1,11 @@
 #ifndef PICTUREBUS_H
 #define PICTUREBUS_H
+#include <array>
 #include <vector>
 #include "Cartridge.h"
 #include "Mapper.h"
+#include "Snapshot.h"
+#include "Watchpoints.h"
 
 namespace sn
 {
@@ -10,20 +13,58 @@ namespace sn
     {
         public:
             PictureBus();
-            Byte read(Address addr);
+            //Pattern tables and name tables are read straight through the page table, the rest the long way
+            Byte read(Address addr)
+            {
+                const Byte* page = addr < 0x4000 ? m_readPages[addr >> 10] : nullptr;
+                if (page)
+                    return page[addr & 0x3ff];
+                return readHandler(addr);
+            }
             void write(Address addr, Byte value);
+            //Accesses of the CPU through PPUDATA, checked against the watchpoints in the pages that have any.
+            //The fetches of the picture aren't, they are skipped in the frames left undrawn
+            Byte readData(Address addr);
+            void writeData(Address addr, Byte value);
 
             bool setMapper(Mapper *mapper);
             Byte readPalette(Byte paletteAddr);
             void updateMirroring();
-            void scanlineIRQ();
+            //Must be called when the mapper switches the CHR banks visible to the PPU
+            void updateCHRPages();
+            //Mappers without a scanline counter aren't called at all
+            void scanlineIRQ()
+            {
+                if (m_hasScanlineIRQ)
+                    m_mapper->scanlineIRQ();
+            }
+            bool hasScanlineIRQ() { return m_hasScanlineIRQ; }
+            //nullptr removes them all
+            void setWatchpoints(Watchpoints* watchpoints);
+
+            //Name tables, palette and the mirroring
+            void saveState(Snapshot& snapshot);
+            void loadState(Snapshot& snapshot);
         private:
+            Byte readHandler(Address addr);
+            void updateNameTablePages();
+
+            //One entry for each 1KB page of 0x0000-0x3fff, pointing at the start of the page.
+            //nullptr if the read has to go through readHandler, like for the palette
+            std::array<const Byte*, 0x10> m_readPages;
+
             std::size_t NameTable0, NameTable1, NameTable2, NameTable3; //indices where they start in RAM vector
 
             std::vector<Byte> m_palette;
 
             std::vector<Byte> m_RAM;
             Mapper* m_mapper;
+            //Fixed for the mapper, it is asked for more than a thousand times a frame
+            bool m_hasScanlineIRQ;
+
+            //Types of access watched in each 1KB page, see WatchType
+            std::array<Byte, 0x10> m_watchedPages;
+            Watchpoints* m_watchpoints;
     };
 }
 #endif // PICTUREBUS_H
@@ -0,0 +1,43 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "Snapshot.h"
+
+namespace sn
+{
+    //Time on the master clock, counted in PPU dots
+    using Timestamp = std::uint64_t;
+    const int DotsPerCPUCycle = 3;
+
+    //Keeps the master clock and knows when the next event of any component is due. An event is anything
+    //another component could observe, like an interrupt or a change of a status register. Up to the next
+    //event a component that is only waiting, like the CPU in an idle loop, doesn't have to be run at all.
+    //The PPU is the only component registered: there is no APU, and the only mapper interrupt (the MMC3
+    //scanline counter) is clocked by the PPU, so it is among the PPU's events
+    class Scheduler
+    {
+    public:
+        Scheduler();
+        void reset();
+
+        Timestamp getTime() { return m_time; }
+        void advance(Timestamp dots) { m_time += dots; }
+
+        //The callback returns the dots until the next event of the component. It is asked every time
+        //the next event is needed, so a component never has to reschedule when its state changes
+        void addComponent(std::function<int(void)> nextEvent);
+        //Dots until the earliest event of all components
+        int getEventHorizon();
+
+        void saveState(Snapshot& snapshot) { snapshot.save(m_time); }
+        void loadState(Snapshot& snapshot) { snapshot.load(m_time); }
+
+    private:
+        Timestamp m_time;
+        std::vector<std::function<int(void)>> m_components;
+    };
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,62 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace sn
+{
+    //State of the console kept in memory. The components save their members one after the other and load them
+    //back in the same order. Pointers are kept as they are, so a snapshot can only be loaded into the console
+    //it was taken from, with the same cartridge still loaded
+    class Snapshot
+    {
+    public:
+        Snapshot();
+        //Starts saving over. The memory is kept, so saving again doesn't allocate
+        void clear();
+        //Goes back to the start for loading
+        void rewind() { m_position = 0; }
+        bool empty() { return m_data.empty(); }
+        std::size_t size() { return m_data.size(); }
+
+        template <typename T>
+        void save(const T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be saved as they are");
+            saveBytes(&value, sizeof(T));
+        }
+        template <typename T>
+        void load(T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be loaded as they are");
+            loadBytes(&value, sizeof(T));
+        }
+
+        //The size of a vector is saved along with its contents
+        template <typename T>
+        void save(const std::vector<T>& values)
+        {
+            save(values.size());
+            saveBytes(values.data(), values.size() * sizeof(T));
+        }
+        template <typename T>
+        void load(std::vector<T>& values)
+        {
+            std::size_t size = 0;
+            load(size);
+            values.resize(size);
+            loadBytes(values.data(), size * sizeof(T));
+        }
+
+    private:
+        void saveBytes(const void* data, std::size_t size);
+        void loadBytes(void* data, std::size_t size);
+
+        std::vector<std::uint8_t> m_data;
+        std::size_t m_position;
+    };
+}
+
+#endif // SNAPSHOT_H
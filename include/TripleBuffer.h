@@ -0,0 +1,52 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+#include <array>
+#include <atomic>
+
+namespace sn
+{
+    //Hands the latest of a stream of values from one thread to another without locking or waiting.
+    //The writer fills the back slot and publishes it by swapping it with the middle one, the reader takes
+    //the middle slot in exchange for its front one. Values the reader never got to are skipped
+    template <typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer(const T& initial) :
+            m_slots{{initial, initial, initial}},
+            m_back(0),
+            m_middle(1),
+            m_front(2)
+        {
+        }
+
+        //Writer side
+        T& back() { return m_slots[m_back]; }
+        void publish()
+        {
+            m_back = m_middle.exchange(m_back | Published, std::memory_order_acq_rel) & IndexMask;
+        }
+
+        //Reader side. Returns false if nothing was published since the last time
+        bool update()
+        {
+            if (!(m_middle.load(std::memory_order_relaxed) & Published))
+                return false;
+            m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+            return true;
+        }
+        const T& front() { return m_slots[m_front]; }
+
+    private:
+        //The middle index is flagged when the writer put it there
+        static const int Published = 4;
+        static const int IndexMask = 3;
+
+        std::array<T, 3> m_slots;
+        int m_back;
+        std::atomic<int> m_middle;
+        int m_front;
+    };
+}
+
+#endif // TRIPLEBUFFER_H
@@ -0,0 +1,56 @@
+#ifndef WATCHPOINTS_H
+#define WATCHPOINTS_H
+#include <functional>
+#include <string>
+#include <vector>
+#include "Cartridge.h"
+
+namespace sn
+{
+    enum AddressSpace
+    {
+        CPUAddressSpace,
+        PPUAddressSpace, //VRAM, as accessed by the CPU through PPUDATA
+    };
+
+    //Kinds of access, combined as bits
+    enum WatchType
+    {
+        WatchRead = 1,
+        WatchWrite = 2,
+        WatchExecute = 4, //CPU only
+    };
+
+    //Read, write and execute breakpoints on ranges of addresses. The buses only send the accesses to the
+    //pages with any watchpoint here, the others keep their fast path, and the CPU ends its cached blocks
+    //before any executed address. A hit is logged along with the access, then the hit callback is called
+    class Watchpoints
+    {
+    public:
+        //Watches [first, last] for the given types of access, any combination of WatchType
+        void add(AddressSpace space, int types, Address first, Address last);
+        //Same with the range given as text, a single address or two separated by '-', in hex.
+        //Returns false if it can't be parsed
+        bool add(AddressSpace space, int types, const std::string& range);
+        bool empty() { return m_watches.empty(); }
+
+        //Types of access watched anywhere in [first, last]
+        int getTypes(AddressSpace space, Address first, Address last);
+        //Reports the access if its address is watched for its type. Returns whether it was
+        bool check(AddressSpace space, WatchType type, Address addr, Byte value = 0);
+
+        void setHitCallback(std::function<void(void)> callback);
+    private:
+        struct Watch
+        {
+            AddressSpace space;
+            int types;
+            Address first;
+            Address last;
+        };
+        std::vector<Watch> m_watches;
+        std::function<void(void)> m_hitCallback;
+    };
+};
+
+#endif // WATCHPOINTS_H
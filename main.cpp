@@ -12,7 +12,11 @@ namespace sn
 
 int main(int argc, char** argv)
 {
-    std::ofstream logFile ("simplenes.log"), cpuTraceFile;
+    std::ofstream logFile ("simplenes.log");
+    sn::CPUTrace cpuTrace;
+    sn::CPUProfiler cpuProfiler;
+    bool profile = false;
+    sn::Watchpoints watchpoints;
     sn::TeeStream logTee (logFile, std::cout);
 
     if (logFile.is_open() && logFile.good())
@@ -23,6 +27,8 @@ int main(int argc, char** argv)
     sn::Log::get().setLevel(sn::Info);
 
     std::string path;
+    int benchmarkFrames = 0;
+    int verifyFrames = 0;
 
     //Default keybindings
     std::vector<sf::Keyboard::Key> p1 {sf::Keyboard::J, sf::Keyboard::K, sf::Keyboard::RShift, sf::Keyboard::Return,
@@ -38,7 +44,9 @@ int main(int argc, char** argv)
         {
             std::cout << "SimpleNES is a simple NES emulator.\n"
                       << "It can run off .nes images.\n"
-                      << "Set keybindings with keybindings.conf\n\n"
+                      << "Set keybindings with keybindings.conf\n"
+                      << "Cheats are read from a .cht file of the same name next to the ROM, one per\n"
+                      << "line: Game Genie codes, or addr=value and addr?compare=value in hex\n\n"
                       << "Usage: SimpleNES [options] rom-path\n\n"
                       << "Options:\n"
                       << "-h, --help             Print this help text and exit\n"
@@ -49,15 +57,109 @@ int main(int argc, char** argv)
                       << "-H, --height           Set the height of the emulation screen (width is\n"
                       << "                       set automatically to fit the aspect ratio)\n"
                       << "                       This option is mutually exclusive to --width\n"
+                      << "-b, --benchmark        Run the given number of frames without a window and\n"
+                      << "                       report the emulation speed\n"
+                      << "--micro-ops            Run hot code through blocks translated to micro-ops,\n"
+                      << "                       with their RAM operands resolved ahead\n"
+                      << "--micro-ops-verify     Same as --micro-ops, also running each translated block\n"
+                      << "                       in the interpreter and logging any difference\n"
+                      << "--fast-forward         Run as fast as possible, showing the frames at the\n"
+                      << "                       display rate. Toggled with Tab while running\n"
+                      << "--run-ahead            Run the given number of frames ahead of the one\n"
+                      << "                       shown and go back, to hide the game's input lag\n"
+                      << "--cycle-accurate       Perform every CPU bus access on its own cycle, with\n"
+                      << "                       the dummy accesses of the hardware. Slower\n"
+                      << "--verify-accuracy      Run the given number of frames without a window, along\n"
+                      << "                       with a cycle accurate CPU, and exit with an error if\n"
+                      << "                       they differ at the end of any frame\n"
+                      << "--log-cpu              Record the executed instructions to sn.cputrace\n"
+                      << "--trace-pc             Only record instructions in the given range of\n"
+                      << "                       addresses, in hex. E.g. --trace-pc c000-c0ff\n"
+                      << "--trace-frames         Only record instructions during the given range of\n"
+                      << "                       frames. E.g. --trace-frames 60-119\n"
+                      << "--decode-trace         Print the given trace as text and exit\n"
+                      << "--profile              Account the CPU cycles to each bank and PC. Writes\n"
+                      << "                       the hotspots to sn.profile and the call stacks to\n"
+                      << "                       sn.folded, for flamegraph.pl, at exit\n"
+                      << "--break-read           Pause when the CPU reads the given address, or range\n"
+                      << "                       of addresses, in hex. E.g. --break-read 6000-60ff\n"
+                      << "--break-write          Pause when the CPU writes the given addresses\n"
+                      << "--break-exec           Pause when the CPU executes the given addresses\n"
+                      << "--break-vram-read      Pause when the CPU reads the given PPU addresses\n"
+                      << "                       through PPUDATA\n"
+                      << "--break-vram-write     Pause when the CPU writes the given PPU addresses\n"
+                      << "                       through PPUDATA\n"
+                      << "                       All of them can be given more than once. Every hit is\n"
+                      << "                       logged with the CPU state, F2 resumes\n"
                       << std::endl;
             return 0;
         }
         else if (std::strcmp(argv[i], "--log-cpu") == 0)
         {
-            sn::Log::get().setLevel(sn::CpuTrace);
-            cpuTraceFile.open("sn.cpudump");
-            sn::Log::get().setCpuTraceStream(cpuTraceFile);
-            LOG(sn::Info) << "CPU logging set." << std::endl;
+            if (cpuTrace.open("sn.cputrace"))
+            {
+                emulator.setCPUTrace(&cpuTrace);
+                LOG(sn::Info) << "CPU logging set." << std::endl;
+            }
+        }
+        else if (std::strcmp(argv[i], "--trace-pc") == 0)
+        {
+            unsigned int first, last;
+            char separator;
+            std::stringstream ss;
+            if (i + 1 < argc && ss << argv[i + 1] && ss >> std::hex >> first >> separator >> last &&
+                separator == '-' && first <= last && last <= 0xffff)
+                cpuTrace.setPCRange(first, last);
+            else
+                LOG(sn::Error) << "Setting traced PC range from argument failed" << std::endl;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--trace-frames") == 0)
+        {
+            std::uint32_t first, last;
+            char separator;
+            std::stringstream ss;
+            if (i + 1 < argc && ss << argv[i + 1] && ss >> first >> separator >> last &&
+                separator == '-' && first <= last)
+                cpuTrace.setFrameRange(first, last);
+            else
+                LOG(sn::Error) << "Setting traced frame range from argument failed" << std::endl;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--profile") == 0)
+        {
+            emulator.setCPUProfiler(&cpuProfiler);
+            profile = true;
+        }
+        else if (std::strncmp(argv[i], "--break-", 8) == 0)
+        {
+            std::string type (argv[i] + 8);
+            sn::AddressSpace space = sn::CPUAddressSpace;
+            if (type.compare(0, 5, "vram-") == 0)
+            {
+                space = sn::PPUAddressSpace;
+                type.erase(0, 5);
+            }
+
+            int types = type == "read" ? sn::WatchRead : type == "write" ? sn::WatchWrite :
+                        type == "exec" && space == sn::CPUAddressSpace ? sn::WatchExecute : 0;
+            if (!types)
+            {
+                std::cerr << "Unrecognized argument: " << argv[i] << std::endl;
+                continue;
+            }
+            if (i + 1 >= argc || !watchpoints.add(space, types, argv[i + 1]))
+            {
+                LOG(sn::Error) << "Setting " << argv[i] << " address range from argument failed" << std::endl;
+            }
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--decode-trace") == 0)
+        {
+            if (i + 1 < argc)
+                return sn::CPUTrace::decode(argv[i + 1], std::cout) ? 0 : 1;
+            LOG(sn::Error) << "Argument required: trace path" << std::endl;
+            return 1;
         }
         else if (std::strcmp(argv[i], "-s") == 0 || std::strcmp(argv[i], "--scale") == 0)
         {
@@ -89,12 +191,53 @@ int main(int argc, char** argv)
                 LOG(sn::Error) << "Setting height from argument failed" << std::endl;
             ++i;
         }
+        else if (std::strcmp(argv[i], "-b") == 0 || std::strcmp(argv[i], "--benchmark") == 0)
+        {
+            int frames;
+            std::stringstream ss;
+            if (i + 1 < argc && ss << argv[i + 1] && ss >> frames)
+                benchmarkFrames = frames;
+            else
+                LOG(sn::Error) << "Setting benchmark frames from argument failed" << std::endl;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--verify-accuracy") == 0)
+        {
+            int frames;
+            std::stringstream ss;
+            if (i + 1 < argc && ss << argv[i + 1] && ss >> frames)
+                verifyFrames = frames;
+            else
+                LOG(sn::Error) << "Setting verified frames from argument failed" << std::endl;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--run-ahead") == 0)
+        {
+            int frames;
+            std::stringstream ss;
+            if (i + 1 < argc && ss << argv[i + 1] && ss >> frames && frames >= 0)
+                emulator.setRunAhead(frames);
+            else
+                LOG(sn::Error) << "Setting run-ahead frames from argument failed" << std::endl;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--micro-ops") == 0)
+            emulator.setTranslation(sn::TranslationOn);
+        else if (std::strcmp(argv[i], "--micro-ops-verify") == 0)
+            emulator.setTranslation(sn::TranslationVerify);
+        else if (std::strcmp(argv[i], "--fast-forward") == 0)
+            emulator.setFastForward(true);
+        else if (std::strcmp(argv[i], "--cycle-accurate") == 0)
+            emulator.setAccuracy(sn::CycleAccuracy);
         else if (argv[i][0] != '-')
             path = argv[i];
         else
             std::cerr << "Unrecognized argument: " << argv[i] << std::endl;
     }
 
+    if (!watchpoints.empty())
+        emulator.setWatchpoints(&watchpoints);
+
     if (path.empty())
     {
         std::cout << "Argument required: ROM path" << std::endl;
@@ -103,8 +246,21 @@ int main(int argc, char** argv)
         // return 1;
     }
 
-    sn::parseControllerConf("keybindings.conf", p1, p2);
-    emulator.setKeys(p1, p2);
-    emulator.run(path);
+    if (verifyFrames > 0)
+    {
+        if (!emulator.verifyAccuracy(path, verifyFrames))
+            return 1;
+    }
+    else if (benchmarkFrames > 0)
+        emulator.benchmark(path, benchmarkFrames);
+    else
+    {
+        sn::parseControllerConf("keybindings.conf", p1, p2);
+        emulator.setKeys(p1, p2);
+        emulator.run(path);
+    }
+
+    if (profile)
+        cpuProfiler.write("sn.profile", "sn.folded");
     return 0;
 }
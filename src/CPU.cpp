@@ -1,29 +1,141 @@
 #include "CPU.h"
 #include "CPUOpcodes.h"
 #include "Log.h"
-#include <iomanip>
+#include <algorithm>
+#include <sstream>
 
 namespace sn
 {
     CPU::CPU(MainBus &mem) :
+        m_instruction(nullptr),
+        m_dummyAccess(false),
+        m_instructionCount(0),
         m_pendingNMI(false),
         m_pendingIRQ(false),
+        m_windowBlocks{},
+        m_currentBlock(nullptr),
+        m_translation(TranslationOff),
+        m_translationBudget(1),
+        m_accuracy(InstructionAccuracy),
+        m_trace(nullptr),
+        m_profiler(nullptr),
+        m_watchpoints(nullptr),
+        m_idleBlock(nullptr),
+        m_idleCycles(0),
         m_bus(mem)
     {}
 
+    void CPU::setAccuracy(CPUAccuracy accuracy)
+    {
+        m_accuracy = accuracy;
+        m_currentBlock = nullptr;
+        m_idleBlock = nullptr;
+    }
+
+    void CPU::setWatchpoints(Watchpoints* watchpoints)
+    {
+        m_watchpoints = watchpoints;
+        //The blocks decoded so far may run over the breakpoints
+        clearBlockCache();
+        updatePRGBanks();
+        m_idleBlock = nullptr;
+    }
+
+    void CPU::log()
+    {
+        //Same layout as the trace
+        TraceRecord record {static_cast<std::uint64_t>(m_cycles), 0, r_PC, m_bus.peek(r_PC),
+                            r_A, r_X, r_Y, getStatus(), r_SP, {}};
+        std::ostringstream line;
+        CPUTrace::format(record, line);
+        LOG(Info) << "CPU state: " << line.str() << std::flush;
+    }
+
+    bool CPU::isInSameState(CPU& other)
+    {
+        return sameRegisters(saveRegisters(), other.saveRegisters()) && m_cycles == other.m_cycles &&
+               m_instructionCount == other.m_instructionCount;
+    }
+
     void CPU::reset()
     {
-        reset(readAddress(ResetVector));
+        //Read straight from the bus, the vector fetch belongs to no frame and mustn't run the PPU
+        reset(m_bus.read(ResetVector) | m_bus.read(ResetVector + 1) << 8);
     }
 
     void CPU::reset(Address start_addr)
     {
-        m_skipCycles = m_cycles = 0;
+        m_instructionCycles = m_cycles = 0;
         r_A = r_X = r_Y = 0;
-        f_I = true;
-        f_C = f_D = f_N = f_V = f_Z = false;
+        setStatus(InterruptFlag);
         r_PC = start_addr;
         r_SP = 0xfd; //documented startup state
+
+        //The cartridge may have changed, decoded code is no longer valid
+        clearBlockCache();
+        updatePRGBanks();
+        m_idleBlock = nullptr;
+    }
+
+    void CPU::saveState(Snapshot& snapshot)
+    {
+        snapshot.save(m_instructionCycles);
+        snapshot.save(m_cycles);
+        snapshot.save(m_instructionCount);
+        snapshot.save(r_PC);
+        snapshot.save(r_SP);
+        snapshot.save(r_A);
+        snapshot.save(r_X);
+        snapshot.save(r_Y);
+        snapshot.save(r_P);
+        snapshot.save(f_C);
+        snapshot.save(f_V);
+        snapshot.save(m_resultNZ);
+        snapshot.save(m_pendingNMI);
+        snapshot.save(m_pendingIRQ);
+        snapshot.save(m_operand);
+        snapshot.save(m_currentBlock);
+        snapshot.save(m_blockPosition);
+        snapshot.save(m_blockPC);
+        snapshot.save(m_busCycles);
+        snapshot.save(m_idleBlock);
+        snapshot.save(m_idlePC);
+        snapshot.save(m_idleStartCycle);
+        snapshot.save(m_idleState);
+        snapshot.save(m_idleCycles);
+    }
+
+    void CPU::loadState(Snapshot& snapshot)
+    {
+        snapshot.load(m_instructionCycles);
+        snapshot.load(m_cycles);
+        snapshot.load(m_instructionCount);
+        snapshot.load(r_PC);
+        snapshot.load(r_SP);
+        snapshot.load(r_A);
+        snapshot.load(r_X);
+        snapshot.load(r_Y);
+        snapshot.load(r_P);
+        snapshot.load(f_C);
+        snapshot.load(f_V);
+        snapshot.load(m_resultNZ);
+        snapshot.load(m_pendingNMI);
+        snapshot.load(m_pendingIRQ);
+        snapshot.load(m_operand);
+        snapshot.load(m_currentBlock);
+        snapshot.load(m_blockPosition);
+        snapshot.load(m_blockPC);
+        snapshot.load(m_busCycles);
+        snapshot.load(m_idleBlock);
+        snapshot.load(m_idlePC);
+        snapshot.load(m_idleStartCycle);
+        snapshot.load(m_idleState);
+        snapshot.load(m_idleCycles);
+
+        //The cache of the banks may have grown and moved since, they are looked up again for the loaded mapper
+        auto block = m_currentBlock;
+        updatePRGBanks();
+        m_currentBlock = block;
     }
 
     void CPU::interrupt(InterruptType type)
@@ -43,642 +155,1217 @@ namespace sn
         }
     }
 
+    template <CPUAccuracy accuracy>
     void CPU::interruptSequence(InterruptType type)
     {
-        if (f_I && type != NMI && type != BRK_)
+        if (getFlag(InterruptFlag) && type != NMI && type != BRK_)
             return;
 
         if (type == BRK_) //Add one if BRK, a quirk of 6502
             ++r_PC;
 
-        pushStack(r_PC >> 8);
-        pushStack(r_PC);
+        pushStack<accuracy>(r_PC >> 8);
+        pushStack<accuracy>(r_PC);
 
-        Byte flags = f_N << 7 |
-                     f_V << 6 |
-                       1 << 5 | //unused bit, supposed to be always 1
-          (type == BRK_) << 4 | //B flag set if BRK
-                     f_D << 3 |
-                     f_I << 2 |
-                     f_Z << 1 |
-                     f_C;
-        pushStack(flags);
+        //B flag set if BRK
+        pushStack<accuracy>(getStatus() | (type == BRK_) << 4);
 
-        f_I = true;
+        setFlag(InterruptFlag, true);
 
         switch (type)
         {
             case IRQ:
             case BRK_:
-                r_PC = readAddress(IRQVector);
+                r_PC = readAddress<accuracy>(IRQVector);
                 break;
             case NMI:
-                r_PC = readAddress(NMIVector);
+                r_PC = readAddress<accuracy>(NMIVector);
                 break;
         }
 
         // Interrupt sequence takes 7, but one cycle was actually spent on this.
-        // So skip 6
-        m_skipCycles += 6;
+        // So add 6
+        m_instructionCycles += 6;
     }
 
+    template <CPUAccuracy accuracy>
     void CPU::pushStack(Byte value)
     {
-        m_bus.write(0x100 | r_SP, value);
+        write<accuracy>(0x100 | r_SP, value);
         --r_SP; //Hardware stacks grow downward!
     }
 
+    template <CPUAccuracy accuracy>
     Byte CPU::pullStack()
     {
-        return m_bus.read(0x100 | ++r_SP);
+        return read<accuracy>(0x100 | ++r_SP);
+    }
+
+    void CPU::tick()
+    {
+        ++m_busCycles;
+        m_cycleCallback();
+    }
+
+    template <CPUAccuracy accuracy>
+    Byte CPU::read(Address addr)
+    {
+        if (accuracy == CycleAccuracy)
+            tick();
+        return m_bus.read(addr);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::write(Address addr, Byte value)
+    {
+        if (accuracy == CycleAccuracy)
+            tick();
+        m_bus.write(addr, value);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::writeModified(Address addr, Byte original, Byte value)
+    {
+        //Mappers with serial ports and the I/O registers see both writes, only internal RAM can't tell them apart
+        if (accuracy == CycleAccuracy || addr >= 0x2000)
+        {
+            m_dummyAccess = true;
+            write<accuracy>(addr, original);
+            m_dummyAccess = false;
+        }
+        write<accuracy>(addr, value);
+    }
+
+    int CPU::getAccessCycle(bool write)
+    {
+        if (m_accuracy == CycleAccuracy)
+            return m_busCycles;
+        if (!m_instruction)
+            return 1;
+
+        //Until the instruction is done m_instructionCycles only holds the extra cycle of a page crossing.
+        //The operand is accessed on the last cycle, except for the read of a read-modify-write, made two cycles
+        //earlier. A dummy access comes on the cycle right before
+        int cycle = m_instructionCycles + m_instruction->cycles;
+        if (!write && m_instruction->readModifyWrite)
+            cycle -= 2;
+        return m_dummyAccess ? cycle - 1 : cycle;
     }
 
-    void CPU::setZN(Byte value)
+    Byte CPU::getStatus()
     {
-        f_Z = !value;
-        f_N = value & 0x80;
+        return r_P | UnusedFlag | isNegative() << 7 | f_V << 6 | isZero() << 1 | f_C;
+    }
+
+    void CPU::setStatus(Byte flags)
+    {
+        r_P = flags & (InterruptFlag | DecimalFlag);
+        f_C = flags & CarryFlag;
+        f_V = flags & OverflowFlag;
+        m_resultNZ = (flags & ZeroFlag ? 0 : 1) | (flags & NegativeFlag) << 8;
     }
 
     void CPU::setPageCrossed(Address a, Address b, int inc)
     {
         //Page is determined by the high byte
         if ((a & 0xff00) != (b & 0xff00))
-            m_skipCycles += inc;
+            m_instructionCycles += inc;
     }
 
     void CPU::skipDMACycles()
     {
-        m_skipCycles += 513; //256 read + 256 write + 1 dummy read
-        m_skipCycles += (m_cycles & 1); //+1 if on odd cycle
+        m_instructionCycles += 513; //256 read + 256 write + 1 dummy read
+        m_instructionCycles += (m_cycles & 1); //+1 if on odd cycle
+    }
+
+    int CPU::run(int cycleBudget)
+    {
+        //The profiling and the accuracy are compiled in steps of their own, so that neither is checked
+        //on every instruction and bus access
+        if (m_accuracy == CycleAccuracy)
+            return m_profiler ? runSteps<true, CycleAccuracy>(cycleBudget) :
+                                runSteps<false, CycleAccuracy>(cycleBudget);
+        return m_profiler ? runSteps<true, InstructionAccuracy>(cycleBudget) :
+                            runSteps<false, InstructionAccuracy>(cycleBudget);
     }
 
-    void CPU::step()
+    template <bool profiling, CPUAccuracy accuracy>
+    int CPU::runSteps(int cycleBudget)
     {
+        int cycles = 0;
+        do
+        {
+            cycles += step<profiling, accuracy>();
+        } while (cycles < cycleBudget);
+        return cycles;
+    }
+
+    template <bool profiling, CPUAccuracy accuracy>
+    int CPU::step()
+    {
+        //m_cycles counts the first cycle of the instruction while it executes,
+        //DMA uses it to find the parity of the current cycle
         ++m_cycles;
+        m_instructionCycles = m_busCycles = 0;
 
-        if (m_skipCycles-- > 1)
-            return;
+        if (m_pendingNMI || m_pendingIRQ)
+            m_idleBlock = nullptr;
 
-        m_skipCycles = 0;
+        Address pc = r_PC;
+        Byte sp = r_SP;
+        int bank = profiling ? m_bus.getPRGBank(pc) : 0;
 
         // NMI has higher priority, check for it first
-        if (m_pendingNMI)
+        if (m_pendingNMI || m_pendingIRQ)
         {
-            interruptSequence(NMI);
+            m_instruction = nullptr;
+            interruptSequence<accuracy>(m_pendingNMI ? NMI : IRQ);
             m_pendingNMI = m_pendingIRQ = false;
-            return;
+            int cycles = finishStep<accuracy>();
+            //The sequence is accounted to the handler, if the interrupt wasn't masked
+            if (profiling && r_PC != pc)
+            {
+                m_profiler->call(m_bus.getPRGBank(r_PC), r_PC, sp);
+                m_profiler->record(m_bus.getPRGBank(r_PC), r_PC, cycles, 0);
+            }
+            return cycles;
         }
-        else if (m_pendingIRQ)
+
+        if (!m_currentBlock || r_PC != m_blockPC || m_blockPosition == m_currentBlock->instructions.size())
         {
-            interruptSequence(IRQ);
-            m_pendingNMI = m_pendingIRQ = false;
-            return;
+            m_currentBlock = findBlock();
+            m_blockPosition = 0;
+
+            m_idleBlock = nullptr;
+            if (m_currentBlock && m_currentBlock->idleLoop)
+            {
+                m_idleBlock = m_currentBlock;
+                m_idlePC = r_PC;
+                m_idleStartCycle = m_cycles;
+                m_idleState = saveRegisters();
+            }
+
+            //Translated blocks don't show up in the trace or the profile, nor do they go through the bus for
+            //the watchpoints, so they are only used when all of them are off
+            if (!profiling && m_currentBlock && m_translation != TranslationOff && !m_trace && !m_watchpoints)
+            {
+                DecodedBlock& block = *m_currentBlock;
+                if (!block.translated && ++block.executions >= TranslationThreshold)
+                    translateBlock(block);
+
+                if (!block.translation.empty())
+                {
+                    int cycles = m_translation == TranslationVerify ? verifyTranslation(block) : runTranslation(block);
+                    m_instructionCycles += cycles;
+                    return finishStep<accuracy>();
+                }
+            }
+        }
+
+        if (m_currentBlock)
+        {
+            const DecodedInstruction& decoded = m_currentBlock->instructions[m_blockPosition++];
+            if (m_trace)
+                traceInstruction(r_PC, decoded.instruction - InstructionTable.data());
+            executeDecoded(decoded);
+            m_blockPC = r_PC;
+            int cycles = finishStep<accuracy>();
+            if (profiling)
+                profileInstruction<accuracy>(bank, pc, sp, *decoded.instruction, cycles);
+            return cycles;
         }
 
-        int psw =    f_N << 7 |
-                     f_V << 6 |
-                       1 << 5 |
-                     f_D << 3 |
-                     f_I << 2 |
-                     f_Z << 1 |
-                     f_C;
-        LOG_CPU << std::hex << std::setfill('0') << std::uppercase
-                  << std::setw(4) << +r_PC
-                  << "  "
-                  << std::setw(2) << +m_bus.read(r_PC)
-                  << "  "
-                  << "A:"   << std::setw(2) << +r_A << " "
-                  << "X:"   << std::setw(2) << +r_X << " "
-                  << "Y:"   << std::setw(2) << +r_Y << " "
-                  << "P:"   << std::setw(2) << psw << " "
-                  << "SP:"  << std::setw(2) << +r_SP  << /*std::endl;*/" "
-                  << "CYC:" << std::setw(3) << std::setfill(' ') << std::dec << ((m_cycles - 1) * 3) % 341
-                  << std::endl;
-
-        Byte opcode = m_bus.read(r_PC++);
-
-        auto CycleLength = OperationCycles[opcode];
-
-        //Using short-circuit evaluation, call the other function only if the first failed
-        //ExecuteImplied must be called first and ExecuteBranch must be before ExecuteType0
-        if (CycleLength && (executeImplied(opcode) || executeBranch(opcode) ||
-                        executeType1(opcode) || executeType2(opcode) || executeType0(opcode)))
+        m_idleBlock = nullptr;
+        if (m_watchpoints)
+            m_watchpoints->check(CPUAddressSpace, WatchExecute, pc);
+        Byte opcode;
+        const Instruction& instruction = fetchInstruction<accuracy>(opcode);
+        m_instruction = &instruction;
+        if (m_trace)
+            traceInstruction(pc, opcode);
+        if (instruction.cycles)
         {
-            m_skipCycles += CycleLength;
+            (this->*instruction.handler)();
+            m_instructionCycles += instruction.cycles;
+            ++m_instructionCount;
             //m_cycles %= 340; //compatibility with Nintendulator log
-            //m_skipCycles = 0; //for TESTING
         }
         else
         {
             LOG(Error) << "Unrecognized opcode: " << std::hex << +opcode << std::endl;
         }
+        int cycles = finishStep<accuracy>();
+        if (profiling)
+            profileInstruction<accuracy>(bank, pc, sp, instruction, cycles);
+        return cycles;
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::profileInstruction(int bank, Address pc, Byte sp, const Instruction& instruction, int cycles)
+    {
+        m_profiler->record(bank, pc, cycles);
+        if (instruction.operation == &CPU::opJSR<accuracy> || instruction.operation == &CPU::opBRK<accuracy>)
+            m_profiler->call(m_bus.getPRGBank(r_PC), r_PC, sp);
+        else if (instruction.operation == &CPU::opRTS<accuracy> || instruction.operation == &CPU::opRTI<accuracy>)
+            m_profiler->ret(r_SP);
     }
 
-    bool CPU::executeImplied(Byte opcode)
+    int CPU::getIdleLoopCycles()
     {
-        switch (static_cast<OperationImplied>(opcode))
+        //Stepping through is needed for the trace
+        if (!m_idleBlock || r_PC != m_idlePC || m_pendingNMI || m_pendingIRQ ||
+            m_trace || m_profiler || m_watchpoints || !sameRegisters(saveRegisters(), m_idleState))
+            return 0;
+
+        //m_cycles was already incremented for the first cycle when the iteration started
+        return m_cycles + 1 - m_idleStartCycle;
+    }
+
+    void CPU::skipIdleLoop(int iterations)
+    {
+        int cycles = getIdleLoopCycles() * iterations;
+        m_cycles += cycles;
+        m_idleStartCycle += cycles;
+        m_idleCycles += cycles;
+        m_instructionCount += m_idleBlock->instructions.size() * iterations;
+    }
+
+    void CPU::traceInstruction(Address pc, Byte opcode)
+    {
+        //The PC is the only register changed by fetching the instruction
+        m_trace->record({static_cast<std::uint64_t>(m_cycles - 1), 0, pc, opcode,
+                         r_A, r_X, r_Y, getStatus(), r_SP, {}});
+    }
+
+    template <CPUAccuracy accuracy>
+    int CPU::finishStep()
+    {
+        //Anything that takes no cycles of its own (an unrecognized opcode) still takes one
+        int cycles = std::max(m_instructionCycles, 1);
+        //Internal cycles of the instruction and the ones taken by DMA
+        if (accuracy == CycleAccuracy)
         {
-            case NOP:
-                break;
-            case BRK:
-                interruptSequence(BRK_);
-                break;
-            case JSR:
-                //Push address of next instruction - 1, thus r_PC + 1 instead of r_PC + 2
-                //since r_PC and r_PC + 1 are address of subroutine
-                pushStack(static_cast<Byte>((r_PC + 1) >> 8));
-                pushStack(static_cast<Byte>(r_PC + 1));
-                r_PC = readAddress(r_PC);
-                break;
-            case RTS:
-                r_PC = pullStack();
-                r_PC |= pullStack() << 8;
-                ++r_PC;
-                break;
-            case RTI:
-                {
-                    Byte flags = pullStack();
-                    f_N = flags & 0x80;
-                    f_V = flags & 0x40;
-                    f_D = flags & 0x8;
-                    f_I = flags & 0x4;
-                    f_Z = flags & 0x2;
-                    f_C = flags & 0x1;
-                }
-                r_PC = pullStack();
-                r_PC |= pullStack() << 8;
-                break;
-            case JMP:
-                r_PC = readAddress(r_PC);
-                break;
-            case JMPI:
-                {
-                    Address location = readAddress(r_PC);
-                    //6502 has a bug such that the when the vector of anindirect address begins at the last byte of a page,
-                    //the second byte is fetched from the beginning of that page rather than the beginning of the next
-                    //Recreating here:
-                    Address Page = location & 0xff00;
-                    r_PC = m_bus.read(location) |
-                           m_bus.read(Page | ((location + 1) & 0xff)) << 8;
-                }
-                break;
-            case PHP:
-                {
-                    Byte flags = f_N << 7 |
-                                 f_V << 6 |
-                                   1 << 5 | //supposed to always be 1
-                                   1 << 4 | //PHP pushes with the B flag as 1, no matter what
-                                 f_D << 3 |
-                                 f_I << 2 |
-                                 f_Z << 1 |
-                                 f_C;
-                    pushStack(flags);
-                }
-                break;
-            case PLP:
-                {
-                    Byte flags = pullStack();
-                    f_N = flags & 0x80;
-                    f_V = flags & 0x40;
-                    f_D = flags & 0x8;
-                    f_I = flags & 0x4;
-                    f_Z = flags & 0x2;
-                    f_C = flags & 0x1;
-                }
-                break;
-            case PHA:
-                pushStack(r_A);
-                break;
-            case PLA:
-                r_A = pullStack();
-                setZN(r_A);
-                break;
-            case DEY:
-                --r_Y;
-                setZN(r_Y);
-                break;
-            case DEX:
-                --r_X;
-                setZN(r_X);
-                break;
-            case TAY:
-                r_Y = r_A;
-                setZN(r_Y);
-                break;
-            case INY:
-                ++r_Y;
-                setZN(r_Y);
-                break;
-            case INX:
-                ++r_X;
-                setZN(r_X);
-                break;
-            case CLC:
-                f_C = false;
-                break;
-            case SEC:
-                f_C = true;
-                break;
-            case CLI:
-                f_I = false;
-                break;
-            case SEI:
-                f_I = true;
-                break;
-            case CLD:
-                f_D = false;
-                break;
-            case SED:
-                f_D = true;
-                break;
-            case TYA:
-                r_A = r_Y;
-                setZN(r_A);
-                break;
-            case CLV:
-                f_V = false;
-                break;
-            case TXA:
-                r_A = r_X;
-                setZN(r_A);
-                break;
-            case TXS:
-                r_SP = r_X;
-                break;
-            case TAX:
-                r_X = r_A;
-                setZN(r_X);
-                break;
-            case TSX:
-                r_X = r_SP;
-                setZN(r_X);
-                break;
-            default:
-                return false;
-        };
-        return true;
+            while (m_busCycles < cycles)
+                tick();
+        }
+        m_cycles += cycles - 1;
+        return cycles;
+    }
+
+    void CPU::executeDecoded(const DecodedInstruction& decoded)
+    {
+        const Instruction& instruction = *decoded.instruction;
+        m_instruction = &instruction;
+        m_operand = decoded.operand;
+        r_PC += instruction.length;
+        (this->*instruction.handler)();
+        m_instructionCycles += instruction.cycles;
+        ++m_instructionCount;
     }
 
-    bool CPU::executeBranch(Byte opcode)
+    template <CPUAccuracy accuracy>
+    const CPU::Instruction& CPU::fetchInstruction(Byte& opcode)
     {
-        if ((opcode & BranchInstructionMask) == BranchInstructionMaskResult)
+        opcode = read<accuracy>(r_PC++);
+        const Instruction& instruction = (accuracy == CycleAccuracy ? CycleInstructionTable : InstructionTable)[opcode];
+        //The operation reads an immediate operand again, that's the bus access of its cycle
+        if (instruction.length > 1)
+            m_operand = instruction.addressing == &CPU::addrImmediate ? m_bus.read(r_PC++) : read<accuracy>(r_PC++);
+        if (instruction.length > 2)
+            m_operand |= read<accuracy>(r_PC++) << 8;
+        //Single byte instructions read the next one anyway
+        else if (instruction.length == 1 && instruction.cycles && accuracy == CycleAccuracy)
+            read<accuracy>(r_PC);
+        return instruction;
+    }
+
+    void CPU::updatePRGBanks()
+    {
+        int banks[4];
+        for (int window = 0; window < 4; ++window)
         {
-            //branch is initialized to the condition required (for the flag specified later)
-            bool branch = opcode & BranchConditionMask;
+            banks[window] = m_bus.getPRGBank(0x8000 + window * 0x2000);
+            //Grow the cache before taking any pointer into it
+            if (banks[window] >= static_cast<int>(m_blockCache.size()))
+                m_blockCache.resize(banks[window] + 1);
+        }
 
-            //set branch to true if the given condition is met by the given flag
-            //We use xnor here, it is true if either both operands are true or false
-            switch (opcode >> BranchOnFlagShift)
+        for (int window = 0; window < 4; ++window)
+        {
+            int bank = banks[window];
+            if (bank < 0)
             {
-                case Negative:
-                    branch = !(branch ^ f_N);
-                    break;
-                case Overflow:
-                    branch = !(branch ^ f_V);
-                    break;
-                case Carry:
-                    branch = !(branch ^ f_C);
-                    break;
-                case Zero:
-                    branch = !(branch ^ f_Z);
-                    break;
-                default:
-                    return false;
+                m_windowBlocks[window] = nullptr;
+                continue;
             }
 
-            if (branch)
-            {
-                int8_t offset = m_bus.read(r_PC++);
-                ++m_skipCycles;
-                auto newPC = static_cast<Address>(r_PC + offset);
-                setPageCrossed(r_PC, newPC, 2);
-                r_PC = newPC;
-            }
-            else
-                ++r_PC;
-            return true;
+            if (m_blockCache[bank].empty())
+                m_blockCache[bank].resize(0x2000);
+            m_windowBlocks[window] = &m_blockCache[bank];
         }
-        return false;
+        m_currentBlock = nullptr;
     }
 
-    bool CPU::executeType1(Byte opcode)
+    void CPU::clearBlockCache()
     {
-        if ((opcode & InstructionModeMask) == 0x1)
+        m_blockCache.clear();
+        for (auto& blocks : m_windowBlocks)
+            blocks = nullptr;
+        m_currentBlock = nullptr;
+    }
+
+    CPU::DecodedBlock* CPU::findBlock()
+    {
+        //Only PRG-ROM is cached, code in RAM may be modified at any time.
+        //With cycle accuracy the code has to be fetched through the bus on its cycles
+        if (r_PC < 0x8000 || m_accuracy == CycleAccuracy)
+            return nullptr;
+
+        BankBlocks* blocks = m_windowBlocks[(r_PC >> 13) & 0x3];
+        if (!blocks)
+            return nullptr;
+
+        auto& block = (*blocks)[r_PC & 0x1fff];
+        if (!block)
         {
-            Address location = 0; //Location of the operand, could be in RAM
-            auto op = static_cast<Operation1>((opcode & OperationMask) >> OperationShift);
-            switch (static_cast<AddrMode1>(
-                    (opcode & AddrModeMask) >> AddrModeShift))
-            {
-                case IndexedIndirectX:
-                    {
-                        Byte zero_addr = r_X + m_bus.read(r_PC++);
-                        //Addresses wrap in zero page mode, thus pass through a mask
-                        location = m_bus.read(zero_addr & 0xff) | m_bus.read((zero_addr + 1) & 0xff) << 8;
-                    }
-                    break;
-                case ZeroPage:
-                    location = m_bus.read(r_PC++);
-                    break;
-                case Immediate:
-                    location = r_PC++;
-                    break;
-                case Absolute:
-                    location = readAddress(r_PC);
-                    r_PC += 2;
-                    break;
-                case IndirectY:
-                    {
-                        Byte zero_addr = m_bus.read(r_PC++);
-                        location = m_bus.read(zero_addr & 0xff) | m_bus.read((zero_addr + 1) & 0xff) << 8;
-                        if (op != STA)
-                            setPageCrossed(location, location + r_Y);
-                        location += r_Y;
-                    }
-                    break;
-                case IndexedX:
-                    // Address wraps around in the zero page
-                    location = (m_bus.read(r_PC++) + r_X) & 0xff;
-                    break;
-                case AbsoluteY:
-                    location = readAddress(r_PC);
-                    r_PC += 2;
-                    if (op != STA)
-                        setPageCrossed(location, location + r_Y);
-                    location += r_Y;
-                    break;
-                case AbsoluteX:
-                    location = readAddress(r_PC);
-                    r_PC += 2;
-                    if (op != STA)
-                        setPageCrossed(location, location + r_X);
-                    location += r_X;
-                    break;
-                default:
-                    return false;
-            }
+            block.reset(new DecodedBlock());
+            decodeBlock(*block, r_PC);
+        }
+        return block->instructions.empty() ? nullptr : block.get();
+    }
 
-            switch (op)
-            {
-                case ORA:
-                    r_A |= m_bus.read(location);
-                    setZN(r_A);
-                    break;
-                case AND:
-                    r_A &= m_bus.read(location);
-                    setZN(r_A);
-                    break;
-                case EOR:
-                    r_A ^= m_bus.read(location);
-                    setZN(r_A);
-                    break;
-                case ADC:
-                    {
-                        Byte operand = m_bus.read(location);
-                        std::uint16_t sum = r_A + operand + f_C;
-                        //Carry forward or UNSIGNED overflow
-                        f_C = sum & 0x100;
-                        //SIGNED overflow, would only happen if the sign of sum is
-                        //different from BOTH the operands
-                        f_V = (r_A ^ sum) & (operand ^ sum) & 0x80;
-                        r_A = static_cast<Byte>(sum);
-                        setZN(r_A);
-                    }
-                    break;
-                case STA:
-                    m_bus.write(location, r_A);
-                    break;
-                case LDA:
-                    r_A = m_bus.read(location);
-                    setZN(r_A);
-                    break;
-                case SBC:
-                    {
-                        //High carry means "no borrow", thus negate and subtract
-                        std::uint16_t subtrahend = m_bus.read(location),
-                                 diff = r_A - subtrahend - !f_C;
-                        //if the ninth bit is 1, the resulting number is negative => borrow => low carry
-                        f_C = !(diff & 0x100);
-                        //Same as ADC, except instead of the subtrahend,
-                        //substitute with it's one complement
-                        f_V = (r_A ^ diff) & (~subtrahend ^ diff) & 0x80;
-                        r_A = diff;
-                        setZN(diff);
-                    }
-                    break;
-                case CMP:
-                    {
-                        std::uint16_t diff = r_A - m_bus.read(location);
-                        f_C = !(diff & 0x100);
-                        setZN(diff);
-                    }
-                    break;
-                default:
-                    return false;
-            }
-            return true;
+    void CPU::decodeBlock(DecodedBlock& block, Address addr)
+    {
+        //The block can't go past the end of its bank, the next one may be switched independently
+        const int bankEnd = (addr & 0xe000) + 0x2000;
+        const std::size_t maxLength = 32;
+
+        int location = addr;
+        while (block.instructions.size() < maxLength)
+        {
+            //Breakpoints are left to the uncached path, which checks them
+            if (m_watchpoints && (m_watchpoints->getTypes(CPUAddressSpace, location, location) & WatchExecute))
+                break;
+
+            const Instruction& instruction = InstructionTable[m_bus.peek(location)];
+            //Unrecognized opcodes are left to the uncached path, which reports them
+            if (!instruction.cycles || location + instruction.length > bankEnd)
+                break;
+            //So is code patched by a cheat, the block would be used wherever its bank is mapped
+            if (m_bus.isPatched(location, location + instruction.length - 1))
+                break;
+
+            Address operand = 0;
+            if (instruction.length > 1)
+                operand = m_bus.peek(location + 1);
+            if (instruction.length > 2)
+                operand |= m_bus.peek(location + 2) << 8;
+            block.instructions.push_back({&instruction, operand});
+
+            location += instruction.length;
+            if (instruction.endsBlock)
+                break;
         }
-        return false;
+
+        if (!block.instructions.empty())
+            detectIdleLoop(block, addr);
     }
 
-    bool CPU::executeType2(Byte opcode)
+    void CPU::detectIdleLoop(DecodedBlock& block, Address addr)
     {
-        if ((opcode & InstructionModeMask) == 2)
+        const DecodedInstruction& last = block.instructions.back();
+        Address next = addr;
+        for (const auto& decoded : block.instructions)
+            next += decoded.instruction->length;
+
+        //Has to loop back to its own start
+        if (last.instruction->operation == &CPU::opJMP)
         {
-            Address location = 0;
-            auto op = static_cast<Operation2>((opcode & OperationMask) >> OperationShift);
-            auto addr_mode =
-                    static_cast<AddrMode2>((opcode & AddrModeMask) >> AddrModeShift);
-            switch (addr_mode)
-            {
-                case Immediate_:
-                    location = r_PC++;
-                    break;
-                case ZeroPage_:
-                    location = m_bus.read(r_PC++);
-                    break;
-                case Accumulator:
-                    break;
-                case Absolute_:
-                    location = readAddress(r_PC);
-                    r_PC += 2;
-                    break;
-                case Indexed:
-                    {
-                        location = m_bus.read(r_PC++);
-                        Byte index;
-                        if (op == LDX || op == STX)
-                            index = r_Y;
-                        else
-                            index = r_X;
-                        //The mask wraps address around zero page
-                        location = (location + index) & 0xff;
-                    }
-                    break;
-                case AbsoluteIndexed:
-                    {
-                        location = readAddress(r_PC);
-                        r_PC += 2;
-                        Byte index;
-                        if (op == LDX || op == STX)
-                            index = r_Y;
-                        else
-                            index = r_X;
-                        setPageCrossed(location, location + index);
-                        location += index;
-                    }
-                    break;
-                default:
-                    return false;
-            }
+            if (last.operand != addr)
+                return;
+        }
+        else if (last.instruction->length != 2 || !last.instruction->endsBlock || //not a branch
+                 static_cast<Address>(next + static_cast<int8_t>(last.operand)) != addr)
+            return;
+
+        //Everything else must only read memory without side effects and leave the registers the same
+        //on every iteration, given the same memory. PPUSTATUS is allowed once as its read only resets
+        //state that stays reset until the PPU sets the flags again
+        int statusReads = 0;
+        for (std::size_t i = 0; i + 1 < block.instructions.size(); ++i)
+        {
+            const Instruction& instruction = *block.instructions[i].instruction;
+            Address location = block.instructions[i].operand;
 
-            std::uint16_t operand = 0;
-            switch (op)
+            //Blocks are only decoded with instruction accuracy
+            const Operation reads[] = {
+                &CPU::opLDA<InstructionAccuracy>, &CPU::opLDX<InstructionAccuracy>, &CPU::opLDY<InstructionAccuracy>,
+                &CPU::opAND<InstructionAccuracy>, &CPU::opORA<InstructionAccuracy>, &CPU::opBIT<InstructionAccuracy>,
+                &CPU::opCMP<InstructionAccuracy>, &CPU::opCPX<InstructionAccuracy>, &CPU::opCPY<InstructionAccuracy>,
+                &CPU::opNOP,
+            };
+            if (std::find(std::begin(reads), std::end(reads), instruction.operation) == std::end(reads))
+                return;
+
+            if (instruction.addressing == &CPU::addrZeroPage)
+                continue;
+            else if (instruction.addressing == &CPU::addrAbsolute)
             {
-                case ASL:
-                case ROL:
-                    if (addr_mode == Accumulator)
-                    {
-                        auto prev_C = f_C;
-                        f_C = r_A & 0x80;
-                        r_A <<= 1;
-                        //If Rotating, set the bit-0 to the the previous carry
-                        r_A = r_A | (prev_C && (op == ROL));
-                        setZN(r_A);
-                    }
-                    else
-                    {
-                        auto prev_C = f_C;
-                        operand = m_bus.read(location);
-                        f_C = operand & 0x80;
-                        operand = operand << 1 | (prev_C && (op == ROL));
-                        setZN(operand);
-                        m_bus.write(location, operand);
-                    }
-                    break;
-                case LSR:
-                case ROR:
-                    if (addr_mode == Accumulator)
-                    {
-                        auto prev_C = f_C;
-                        f_C = r_A & 1;
-                        r_A >>= 1;
-                        //If Rotating, set the bit-7 to the previous carry
-                        r_A = r_A | (prev_C && (op == ROR)) << 7;
-                        setZN(r_A);
-                    }
-                    else
-                    {
-                        auto prev_C = f_C;
-                        operand = m_bus.read(location);
-                        f_C = operand & 1;
-                        operand = operand >> 1 | (prev_C && (op == ROR)) << 7;
-                        setZN(operand);
-                        m_bus.write(location, operand);
-                    }
-                    break;
-                case STX:
-                    m_bus.write(location, r_X);
-                    break;
-                case LDX:
-                    r_X = m_bus.read(location);
-                    setZN(r_X);
-                    break;
-                case DEC:
-                    {
-                        auto tmp = m_bus.read(location) - 1;
-                        setZN(tmp);
-                        m_bus.write(location, tmp);
-                    }
-                    break;
-                case INC:
-                    {
-                        auto tmp = m_bus.read(location) + 1;
-                        setZN(tmp);
-                        m_bus.write(location, tmp);
-                    }
-                    break;
-                default:
-                    return false;
+                if (location >= 0x2000 && location < 0x4000 && (location & 0x2007) == PPUSTATUS)
+                    ++statusReads;
+                else if (location >= 0x2000 && (location < 0x6000 || location >= 0x8000))
+                    return;
             }
-            return true;
+            else if (instruction.addressing != &CPU::addrImmediate && instruction.addressing != &CPU::addrImplied)
+                return;
+        }
+
+        if (statusReads > 1)
+            return;
+
+        block.idleLoop = true;
+        block.pollsStatus = statusReads;
+    }
+
+    template <CPU::AddressingMode addressing, CPU::Operation operation>
+    void CPU::execute()
+    {
+        (this->*operation)((this->*addressing)());
+    }
+
+    template <CPU::AddressingMode addressing, CPU::Operation operation>
+    CPU::Specialization CPU::specialize()
+    {
+        return {addressing, operation, &CPU::execute<addressing, operation>};
+    }
+
+    template <CPUAccuracy accuracy, CPU::Operation operation, bool pageCrossPenalty>
+    CPU::Specializations CPU::type1Specializations()
+    {
+        //Ordered by AddrMode1
+        return {{
+            specialize<&CPU::addrIndexedIndirectX<accuracy>, operation>(),
+            specialize<&CPU::addrZeroPage, operation>(),
+            specialize<&CPU::addrImmediate, operation>(),
+            specialize<&CPU::addrAbsolute, operation>(),
+            specialize<&CPU::addrIndirectY<accuracy, pageCrossPenalty>, operation>(),
+            specialize<&CPU::addrZeroPageX<accuracy>, operation>(),
+            specialize<&CPU::addrAbsoluteY<accuracy, pageCrossPenalty>, operation>(),
+            specialize<&CPU::addrAbsoluteX<accuracy, pageCrossPenalty>, operation>(),
+        }};
+    }
+
+    template <CPUAccuracy accuracy, CPU::Operation operation, bool indexedByY>
+    CPU::Specializations CPU::type2Specializations()
+    {
+        //Ordered by AddrMode2, the accumulator mode has operations of its own
+        Specializations specializations {};
+        specializations[Immediate_] = specialize<&CPU::addrImmediate, operation>();
+        specializations[ZeroPage_] = specialize<&CPU::addrZeroPage, operation>();
+        specializations[Absolute_] = specialize<&CPU::addrAbsolute, operation>();
+        if (indexedByY)
+        {
+            specializations[Indexed] = specialize<&CPU::addrZeroPageY<accuracy>, operation>();
+            specializations[AbsoluteIndexed] = specialize<&CPU::addrAbsoluteY<accuracy, true>, operation>();
         }
-        return false;
+        else
+        {
+            specializations[Indexed] = specialize<&CPU::addrZeroPageX<accuracy>, operation>();
+            specializations[AbsoluteIndexed] = specialize<&CPU::addrAbsoluteX<accuracy, true>, operation>();
+        }
+        return specializations;
     }
 
-    bool CPU::executeType0(Byte opcode)
+    template <CPUAccuracy accuracy>
+    std::array<CPU::Instruction, 0x100> CPU::buildInstructionTable()
     {
-        if ((opcode & InstructionModeMask) == 0x0)
+        //Indexed by the operation bits of the opcode
+        const Specializations type1[] = {
+            type1Specializations<accuracy, &CPU::opORA<accuracy>>(),
+            type1Specializations<accuracy, &CPU::opAND<accuracy>>(),
+            type1Specializations<accuracy, &CPU::opEOR<accuracy>>(),
+            type1Specializations<accuracy, &CPU::opADC<accuracy>>(),
+            type1Specializations<accuracy, &CPU::opSTA<accuracy>, false>(),
+            type1Specializations<accuracy, &CPU::opLDA<accuracy>>(),
+            type1Specializations<accuracy, &CPU::opCMP<accuracy>>(),
+            type1Specializations<accuracy, &CPU::opSBC<accuracy>>(),
+        };
+        //LDX and STX are indexed by Y instead of X
+        Specializations type2[] = {
+            type2Specializations<accuracy, &CPU::opASL<accuracy>>(),
+            type2Specializations<accuracy, &CPU::opROL<accuracy>>(),
+            type2Specializations<accuracy, &CPU::opLSR<accuracy>>(),
+            type2Specializations<accuracy, &CPU::opROR<accuracy>>(),
+            type2Specializations<accuracy, &CPU::opSTX<accuracy>, true>(),
+            type2Specializations<accuracy, &CPU::opLDX<accuracy>, true>(),
+            type2Specializations<accuracy, &CPU::opDEC<accuracy>>(),
+            type2Specializations<accuracy, &CPU::opINC<accuracy>>(),
+        };
+        type2[ASL][Accumulator] = specialize<&CPU::addrImplied, &CPU::opASLAccumulator>();
+        type2[ROL][Accumulator] = specialize<&CPU::addrImplied, &CPU::opROLAccumulator>();
+        type2[LSR][Accumulator] = specialize<&CPU::addrImplied, &CPU::opLSRAccumulator>();
+        type2[ROR][Accumulator] = specialize<&CPU::addrImplied, &CPU::opRORAccumulator>();
+        //Indexed by Operation0, the other operations are unused
+        const Specializations type0[] = {
+            {},
+            type2Specializations<accuracy, &CPU::opBIT<accuracy>>(),
+            {},
+            {},
+            type2Specializations<accuracy, &CPU::opSTY<accuracy>>(),
+            type2Specializations<accuracy, &CPU::opLDY<accuracy>>(),
+            type2Specializations<accuracy, &CPU::opCPY<accuracy>>(),
+            type2Specializations<accuracy, &CPU::opCPX<accuracy>>(),
+        };
+        //Ordered by BranchOnFlag, each followed by the opposite condition
+        const Specialization branches[] = {
+            specialize<&CPU::addrImplied, &CPU::opBPL>(), specialize<&CPU::addrImplied, &CPU::opBMI>(),
+            specialize<&CPU::addrImplied, &CPU::opBVC>(), specialize<&CPU::addrImplied, &CPU::opBVS>(),
+            specialize<&CPU::addrImplied, &CPU::opBCC>(), specialize<&CPU::addrImplied, &CPU::opBCS>(),
+            specialize<&CPU::addrImplied, &CPU::opBNE>(), specialize<&CPU::addrImplied, &CPU::opBEQ>(),
+        };
+
+        //Operations on memory that read and write back their operand, the accumulator forms are apart
+        const Operation modifying[] = {
+            &CPU::opASL<accuracy>, &CPU::opLSR<accuracy>, &CPU::opROL<accuracy>,
+            &CPU::opROR<accuracy>, &CPU::opINC<accuracy>, &CPU::opDEC<accuracy>,
+        };
+
+        std::array<Instruction, 0x100> table;
+        for (int i = 0; i < 0x100; ++i)
         {
-            Address location = 0;
-            switch (static_cast<AddrMode2>((opcode & AddrModeMask) >> AddrModeShift))
+            Byte opcode = i;
+            Specialization specialization {};
+            Instruction instruction {nullptr, nullptr, nullptr, OperationCycles[opcode], 1, false, false};
+            auto op = (opcode & OperationMask) >> OperationShift;
+            auto addr_mode = (opcode & AddrModeMask) >> AddrModeShift;
+
+            //The order is the same as the decoding was done before: Implied, Branch and then by instruction mode
+            switch (static_cast<OperationImplied>(opcode))
             {
-                case Immediate_:
-                    location = r_PC++;
-                    break;
-                case ZeroPage_:
-                    location = m_bus.read(r_PC++);
-                    break;
-                case Absolute_:
-                    location = readAddress(r_PC);
-                    r_PC += 2;
-                    break;
-                case Indexed:
-                    // Address wraps around in the zero page
-                    location = (m_bus.read(r_PC++) + r_X) & 0xff;
-                    break;
-                case AbsoluteIndexed:
-                    location = readAddress(r_PC);
-                    r_PC += 2;
-                    setPageCrossed(location, location + r_X);
-                    location += r_X;
-                    break;
+                case NOP:   specialization = specialize<&CPU::addrImplied, &CPU::opNOP>();             break;
+                case BRK:   specialization = specialize<&CPU::addrImplied, &CPU::opBRK<accuracy>>();   instruction.endsBlock = true;   break;
+                case JSR:   specialization = specialize<&CPU::addrImplied, &CPU::opJSR<accuracy>>();   instruction.endsBlock = true;   instruction.length = 3; break;
+                case RTS:   specialization = specialize<&CPU::addrImplied, &CPU::opRTS<accuracy>>();   instruction.endsBlock = true;   break;
+                case RTI:   specialization = specialize<&CPU::addrImplied, &CPU::opRTI<accuracy>>();   instruction.endsBlock = true;   break;
+                case JMP:   specialization = specialize<&CPU::addrImplied, &CPU::opJMP>();             instruction.endsBlock = true;   instruction.length = 3; break;
+                case JMPI:  specialization = specialize<&CPU::addrImplied, &CPU::opJMPI<accuracy>>();  instruction.endsBlock = true;   instruction.length = 3; break;
+                case PHP:   specialization = specialize<&CPU::addrImplied, &CPU::opPHP<accuracy>>();   break;
+                case PLP:   specialization = specialize<&CPU::addrImplied, &CPU::opPLP<accuracy>>();   break;
+                case PHA:   specialization = specialize<&CPU::addrImplied, &CPU::opPHA<accuracy>>();   break;
+                case PLA:   specialization = specialize<&CPU::addrImplied, &CPU::opPLA<accuracy>>();   break;
+                case DEY:   specialization = specialize<&CPU::addrImplied, &CPU::opDEY>();             break;
+                case DEX:   specialization = specialize<&CPU::addrImplied, &CPU::opDEX>();             break;
+                case TAY:   specialization = specialize<&CPU::addrImplied, &CPU::opTAY>();             break;
+                case INY:   specialization = specialize<&CPU::addrImplied, &CPU::opINY>();             break;
+                case INX:   specialization = specialize<&CPU::addrImplied, &CPU::opINX>();             break;
+                case CLC:   specialization = specialize<&CPU::addrImplied, &CPU::opCLC>();             break;
+                case SEC:   specialization = specialize<&CPU::addrImplied, &CPU::opSEC>();             break;
+                case CLI:   specialization = specialize<&CPU::addrImplied, &CPU::opCLI>();             break;
+                case SEI:   specialization = specialize<&CPU::addrImplied, &CPU::opSEI>();             break;
+                case CLD:   specialization = specialize<&CPU::addrImplied, &CPU::opCLD>();             break;
+                case SED:   specialization = specialize<&CPU::addrImplied, &CPU::opSED>();             break;
+                case TYA:   specialization = specialize<&CPU::addrImplied, &CPU::opTYA>();             break;
+                case CLV:   specialization = specialize<&CPU::addrImplied, &CPU::opCLV>();             break;
+                case TXA:   specialization = specialize<&CPU::addrImplied, &CPU::opTXA>();             break;
+                case TXS:   specialization = specialize<&CPU::addrImplied, &CPU::opTXS>();             break;
+                case TAX:   specialization = specialize<&CPU::addrImplied, &CPU::opTAX>();             break;
+                case TSX:   specialization = specialize<&CPU::addrImplied, &CPU::opTSX>();             break;
                 default:
-                    return false;
-            }
-            std::uint16_t operand = 0;
-            switch (static_cast<Operation0>((opcode & OperationMask) >> OperationShift))
-            {
-                case BIT:
-                    operand = m_bus.read(location);
-                    f_Z = !(r_A & operand);
-                    f_V = operand & 0x40;
-                    f_N = operand & 0x80;
-                    break;
-                case STY:
-                    m_bus.write(location, r_Y);
-                    break;
-                case LDY:
-                    r_Y = m_bus.read(location);
-                    setZN(r_Y);
-                    break;
-                case CPY:
-                    {
-                        std::uint16_t diff = r_Y - m_bus.read(location);
-                        f_C = !(diff & 0x100);
-                        setZN(diff);
-                    }
-                    break;
-                case CPX:
+                    if ((opcode & BranchInstructionMask) == BranchInstructionMaskResult)
                     {
-                        std::uint16_t diff = r_X - m_bus.read(location);
-                        f_C = !(diff & 0x100);
-                        setZN(diff);
+                        specialization = branches[(opcode >> BranchOnFlagShift) * 2 + !!(opcode & BranchConditionMask)];
+                        instruction.endsBlock = true;
+                        instruction.length = 2;
                     }
-                    break;
-                default:
-                    return false;
+                    else if ((opcode & InstructionModeMask) == 0x1)
+                        specialization = type1[op][addr_mode];
+                    else if ((opcode & InstructionModeMask) == 0x2)
+                        specialization = type2[op][addr_mode];
+                    else if ((opcode & InstructionModeMask) == 0x0)
+                        specialization = type0[op][addr_mode];
             }
 
-            return true;
+            instruction.addressing = specialization.addressing;
+            instruction.operation = specialization.operation;
+            instruction.handler = specialization.handler;
+            if (!instruction.operation)
+                instruction.cycles = 0;
+            instruction.readModifyWrite = std::find(std::begin(modifying), std::end(modifying),
+                                                    instruction.operation) != std::end(modifying);
+
+            //Implied, accumulator and unused instructions only have the opcode
+            if (!instruction.cycles)
+                instruction.length = 1;
+            else if (instruction.addressing == &CPU::addrAbsolute ||
+                     instruction.addressing == &CPU::addrAbsoluteX<accuracy, true> ||
+                     instruction.addressing == &CPU::addrAbsoluteY<accuracy, true> ||
+                     instruction.addressing == &CPU::addrAbsoluteX<accuracy, false> ||
+                     instruction.addressing == &CPU::addrAbsoluteY<accuracy, false>)
+                instruction.length = 3;
+            else if (instruction.addressing != &CPU::addrImplied)
+                instruction.length = 2;
+            table[opcode] = instruction;
+        }
+        return table;
+    }
+
+    const std::array<CPU::Instruction, 0x100> CPU::InstructionTable = CPU::buildInstructionTable<InstructionAccuracy>();
+    const std::array<CPU::Instruction, 0x100> CPU::CycleInstructionTable = CPU::buildInstructionTable<CycleAccuracy>();
+
+    Address CPU::addrImplied()
+    {
+        return 0;
+    }
+
+    Address CPU::addrImmediate()
+    {
+        //The PC is already past the operand
+        return r_PC - 1;
+    }
+
+    Address CPU::addrZeroPage()
+    {
+        return m_operand;
+    }
+
+    template <CPUAccuracy accuracy>
+    Address CPU::addrZeroPageX()
+    {
+        //The base address is read while the index is added
+        if (accuracy == CycleAccuracy)
+            read<accuracy>(m_operand);
+        // Address wraps around in the zero page
+        return (m_operand + r_X) & 0xff;
+    }
+
+    template <CPUAccuracy accuracy>
+    Address CPU::addrZeroPageY()
+    {
+        if (accuracy == CycleAccuracy)
+            read<accuracy>(m_operand);
+        return (m_operand + r_Y) & 0xff;
+    }
+
+    Address CPU::addrAbsolute()
+    {
+        return m_operand;
+    }
+
+    template <CPUAccuracy accuracy, bool pageCrossPenalty>
+    Address CPU::addIndex(Address location, Byte index)
+    {
+        Address indexed = location + index;
+        if (pageCrossPenalty)
+            setPageCrossed(location, indexed);
+        //The hardware reads before carrying into the high byte, stores always do. Reading an I/O register
+        //has side effects, so that read is made with any accuracy
+        Address uncarried = (location & 0xff00) | (indexed & 0xff);
+        if ((!pageCrossPenalty || uncarried != indexed) &&
+            (accuracy == CycleAccuracy || (uncarried >= 0x2000 && uncarried < 0x4020)))
+        {
+            m_dummyAccess = true;
+            read<accuracy>(uncarried);
+            m_dummyAccess = false;
+        }
+        return indexed;
+    }
+
+    template <CPUAccuracy accuracy, bool pageCrossPenalty>
+    Address CPU::addrAbsoluteX()
+    {
+        return addIndex<accuracy, pageCrossPenalty>(addrAbsolute(), r_X);
+    }
+
+    template <CPUAccuracy accuracy, bool pageCrossPenalty>
+    Address CPU::addrAbsoluteY()
+    {
+        return addIndex<accuracy, pageCrossPenalty>(addrAbsolute(), r_Y);
+    }
+
+    template <CPUAccuracy accuracy>
+    Address CPU::addrIndexedIndirectX()
+    {
+        if (accuracy == CycleAccuracy)
+            read<accuracy>(m_operand);
+        Byte zero_addr = r_X + m_operand;
+        //Addresses wrap in zero page mode, thus pass through a mask
+        return read<accuracy>(zero_addr & 0xff) | read<accuracy>((zero_addr + 1) & 0xff) << 8;
+    }
+
+    template <CPUAccuracy accuracy, bool pageCrossPenalty>
+    Address CPU::addrIndirectY()
+    {
+        Byte zero_addr = m_operand;
+        Address location = read<accuracy>(zero_addr & 0xff) | read<accuracy>((zero_addr + 1) & 0xff) << 8;
+        return addIndex<accuracy, pageCrossPenalty>(location, r_Y);
+    }
+
+    void CPU::opNOP(Address)
+    {
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opBRK(Address)
+    {
+        interruptSequence<accuracy>(BRK_);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opJSR(Address)
+    {
+        //Push address of next instruction - 1
+        pushStack<accuracy>(static_cast<Byte>((r_PC - 1) >> 8));
+        pushStack<accuracy>(static_cast<Byte>(r_PC - 1));
+        r_PC = m_operand;
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opRTS(Address)
+    {
+        r_PC = pullStack<accuracy>();
+        r_PC |= pullStack<accuracy>() << 8;
+        ++r_PC;
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opRTI(Address)
+    {
+        setStatus(pullStack<accuracy>());
+        r_PC = pullStack<accuracy>();
+        r_PC |= pullStack<accuracy>() << 8;
+    }
+
+    void CPU::opJMP(Address)
+    {
+        r_PC = m_operand;
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opJMPI(Address)
+    {
+        Address location = m_operand;
+        //6502 has a bug such that the when the vector of anindirect address begins at the last byte of a page,
+        //the second byte is fetched from the beginning of that page rather than the beginning of the next
+        //Recreating here:
+        Address Page = location & 0xff00;
+        r_PC = read<accuracy>(location) |
+               read<accuracy>(Page | ((location + 1) & 0xff)) << 8;
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opPHP(Address)
+    {
+        //PHP pushes with the B flag as 1, no matter what
+        pushStack<accuracy>(getStatus() | BreakFlag);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opPLP(Address)
+    {
+        setStatus(pullStack<accuracy>());
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opPHA(Address)
+    {
+        pushStack<accuracy>(r_A);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opPLA(Address)
+    {
+        r_A = pullStack<accuracy>();
+        setZN(r_A);
+    }
+
+    void CPU::opDEY(Address)
+    {
+        --r_Y;
+        setZN(r_Y);
+    }
+
+    void CPU::opDEX(Address)
+    {
+        --r_X;
+        setZN(r_X);
+    }
+
+    void CPU::opTAY(Address)
+    {
+        r_Y = r_A;
+        setZN(r_Y);
+    }
+
+    void CPU::opINY(Address)
+    {
+        ++r_Y;
+        setZN(r_Y);
+    }
+
+    void CPU::opINX(Address)
+    {
+        ++r_X;
+        setZN(r_X);
+    }
+
+    void CPU::opCLC(Address)
+    {
+        setFlag(CarryFlag, false);
+    }
+
+    void CPU::opSEC(Address)
+    {
+        setFlag(CarryFlag, true);
+    }
+
+    void CPU::opCLI(Address)
+    {
+        setFlag(InterruptFlag, false);
+    }
+
+    void CPU::opSEI(Address)
+    {
+        setFlag(InterruptFlag, true);
+    }
+
+    void CPU::opCLD(Address)
+    {
+        setFlag(DecimalFlag, false);
+    }
+
+    void CPU::opSED(Address)
+    {
+        setFlag(DecimalFlag, true);
+    }
+
+    void CPU::opTYA(Address)
+    {
+        r_A = r_Y;
+        setZN(r_A);
+    }
+
+    void CPU::opCLV(Address)
+    {
+        setFlag(OverflowFlag, false);
+    }
+
+    void CPU::opTXA(Address)
+    {
+        r_A = r_X;
+        setZN(r_A);
+    }
+
+    void CPU::opTXS(Address)
+    {
+        r_SP = r_X;
+    }
+
+    void CPU::opTAX(Address)
+    {
+        r_X = r_A;
+        setZN(r_X);
+    }
+
+    void CPU::opTSX(Address)
+    {
+        r_X = r_SP;
+        setZN(r_X);
+    }
+
+    void CPU::opBPL(Address)
+    {
+        branch(!isNegative());
+    }
+
+    void CPU::opBMI(Address)
+    {
+        branch(isNegative());
+    }
+
+    void CPU::opBVC(Address)
+    {
+        branch(!getFlag(OverflowFlag));
+    }
+
+    void CPU::opBVS(Address)
+    {
+        branch(getFlag(OverflowFlag));
+    }
+
+    void CPU::opBCC(Address)
+    {
+        branch(!getFlag(CarryFlag));
+    }
+
+    void CPU::opBCS(Address)
+    {
+        branch(getFlag(CarryFlag));
+    }
+
+    void CPU::opBNE(Address)
+    {
+        branch(!isZero());
+    }
+
+    void CPU::opBEQ(Address)
+    {
+        branch(isZero());
+    }
+
+    void CPU::branch(bool condition)
+    {
+        if (condition)
+        {
+            int8_t offset = m_operand;
+            ++m_instructionCycles;
+            auto newPC = static_cast<Address>(r_PC + offset);
+            setPageCrossed(r_PC, newPC, 2);
+            r_PC = newPC;
         }
-        return false;
     }
 
+    template <CPUAccuracy accuracy>
+    void CPU::opORA(Address location)
+    {
+        r_A |= read<accuracy>(location);
+        setZN(r_A);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opAND(Address location)
+    {
+        r_A &= read<accuracy>(location);
+        setZN(r_A);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opEOR(Address location)
+    {
+        r_A ^= read<accuracy>(location);
+        setZN(r_A);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opADC(Address location)
+    {
+        Byte operand = read<accuracy>(location);
+        std::uint16_t sum = r_A + operand + getFlag(CarryFlag);
+        //Carry forward or UNSIGNED overflow
+        setFlag(CarryFlag, sum & 0x100);
+        //SIGNED overflow, would only happen if the sign of sum is
+        //different from BOTH the operands
+        setFlag(OverflowFlag, (r_A ^ sum) & (operand ^ sum) & 0x80);
+        r_A = static_cast<Byte>(sum);
+        setZN(r_A);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opSTA(Address location)
+    {
+        write<accuracy>(location, r_A);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opLDA(Address location)
+    {
+        r_A = read<accuracy>(location);
+        setZN(r_A);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opCMP(Address location)
+    {
+        std::uint16_t diff = r_A - read<accuracy>(location);
+        setFlag(CarryFlag, !(diff & 0x100));
+        setZN(diff);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opSBC(Address location)
+    {
+        //High carry means "no borrow", thus negate and subtract
+        std::uint16_t subtrahend = read<accuracy>(location),
+                 diff = r_A - subtrahend - !getFlag(CarryFlag);
+        //if the ninth bit is 1, the resulting number is negative => borrow => low carry
+        setFlag(CarryFlag, !(diff & 0x100));
+        //Same as ADC, except instead of the subtrahend,
+        //substitute with it's one complement
+        setFlag(OverflowFlag, (r_A ^ diff) & (~subtrahend ^ diff) & 0x80);
+        r_A = diff;
+        setZN(diff);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opASL(Address location)
+    {
+        Byte original = read<accuracy>(location), operand = original;
+        setFlag(CarryFlag, operand & 0x80);
+        operand <<= 1;
+        setZN(operand);
+        writeModified<accuracy>(location, original, operand);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opROL(Address location)
+    {
+        auto prev_C = getFlag(CarryFlag);
+        Byte original = read<accuracy>(location), operand = original;
+        setFlag(CarryFlag, operand & 0x80);
+        //Set the bit-0 to the the previous carry
+        operand = operand << 1 | prev_C;
+        setZN(operand);
+        writeModified<accuracy>(location, original, operand);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opLSR(Address location)
+    {
+        Byte original = read<accuracy>(location), operand = original;
+        setFlag(CarryFlag, operand & 1);
+        operand >>= 1;
+        setZN(operand);
+        writeModified<accuracy>(location, original, operand);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opROR(Address location)
+    {
+        auto prev_C = getFlag(CarryFlag);
+        Byte original = read<accuracy>(location), operand = original;
+        setFlag(CarryFlag, operand & 1);
+        //Set the bit-7 to the previous carry
+        operand = operand >> 1 | prev_C << 7;
+        setZN(operand);
+        writeModified<accuracy>(location, original, operand);
+    }
+
+    void CPU::opASLAccumulator(Address)
+    {
+        setFlag(CarryFlag, r_A & 0x80);
+        r_A <<= 1;
+        setZN(r_A);
+    }
+
+    void CPU::opROLAccumulator(Address)
+    {
+        auto prev_C = getFlag(CarryFlag);
+        setFlag(CarryFlag, r_A & 0x80);
+        r_A = r_A << 1 | prev_C;
+        setZN(r_A);
+    }
+
+    void CPU::opLSRAccumulator(Address)
+    {
+        setFlag(CarryFlag, r_A & 1);
+        r_A >>= 1;
+        setZN(r_A);
+    }
+
+    void CPU::opRORAccumulator(Address)
+    {
+        auto prev_C = getFlag(CarryFlag);
+        setFlag(CarryFlag, r_A & 1);
+        r_A = r_A >> 1 | prev_C << 7;
+        setZN(r_A);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opSTX(Address location)
+    {
+        write<accuracy>(location, r_X);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opLDX(Address location)
+    {
+        r_X = read<accuracy>(location);
+        setZN(r_X);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opDEC(Address location)
+    {
+        Byte original = read<accuracy>(location), tmp = original - 1;
+        setZN(tmp);
+        writeModified<accuracy>(location, original, tmp);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opINC(Address location)
+    {
+        Byte original = read<accuracy>(location), tmp = original + 1;
+        setZN(tmp);
+        writeModified<accuracy>(location, original, tmp);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opBIT(Address location)
+    {
+        Byte operand = read<accuracy>(location);
+        setFlag(OverflowFlag, operand & 0x40);
+        //Z from the AND with A, N from the operand's bit 7
+        m_resultNZ = (r_A & operand) | (operand & 0x80) << 8;
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opSTY(Address location)
+    {
+        write<accuracy>(location, r_Y);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opLDY(Address location)
+    {
+        r_Y = read<accuracy>(location);
+        setZN(r_Y);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opCPY(Address location)
+    {
+        std::uint16_t diff = r_Y - read<accuracy>(location);
+        setFlag(CarryFlag, !(diff & 0x100));
+        setZN(diff);
+    }
+
+    template <CPUAccuracy accuracy>
+    void CPU::opCPX(Address location)
+    {
+        std::uint16_t diff = r_X - read<accuracy>(location);
+        setFlag(CarryFlag, !(diff & 0x100));
+        setZN(diff);
+    }
+
+    template <CPUAccuracy accuracy>
     Address CPU::readAddress(Address addr)
     {
-        return m_bus.read(addr) | m_bus.read(addr + 1) << 8;
+        return read<accuracy>(addr) | read<accuracy>(addr + 1) << 8;
     }
 
+    //The translation identifies the decoded instructions by these, see CPUTranslation.cpp
+    template void CPU::opLDA<InstructionAccuracy>(Address);
+    template void CPU::opLDX<InstructionAccuracy>(Address);
+    template void CPU::opLDY<InstructionAccuracy>(Address);
+    template void CPU::opSTA<InstructionAccuracy>(Address);
+    template void CPU::opSTX<InstructionAccuracy>(Address);
+    template void CPU::opSTY<InstructionAccuracy>(Address);
+    template void CPU::opORA<InstructionAccuracy>(Address);
+    template void CPU::opAND<InstructionAccuracy>(Address);
+    template void CPU::opEOR<InstructionAccuracy>(Address);
+    template void CPU::opADC<InstructionAccuracy>(Address);
+    template void CPU::opSBC<InstructionAccuracy>(Address);
+    template void CPU::opCMP<InstructionAccuracy>(Address);
+    template void CPU::opCPX<InstructionAccuracy>(Address);
+    template void CPU::opCPY<InstructionAccuracy>(Address);
+    template void CPU::opBIT<InstructionAccuracy>(Address);
+    template void CPU::opASL<InstructionAccuracy>(Address);
+    template void CPU::opLSR<InstructionAccuracy>(Address);
+    template void CPU::opROL<InstructionAccuracy>(Address);
+    template void CPU::opROR<InstructionAccuracy>(Address);
+    template void CPU::opINC<InstructionAccuracy>(Address);
+    template void CPU::opDEC<InstructionAccuracy>(Address);
+    template Address CPU::addrZeroPageX<InstructionAccuracy>();
+    template Address CPU::addrZeroPageY<InstructionAccuracy>();
+
 };
 
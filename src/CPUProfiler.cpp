@@ -0,0 +1,116 @@
+#include "CPUProfiler.h"
+#include "Log.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace sn
+{
+    CPUProfiler::CPUProfiler() :
+        m_totalCycles(0),
+        m_currentFrame(0)
+    {
+        //Nothing on the stack can return past the first frame
+        m_frames.push_back({0, 0, 0x200, 0, {}});
+    }
+
+    void CPUProfiler::record(int bank, Address pc, int cycles, int instructions)
+    {
+        auto& counters = m_locations[location(bank, pc)];
+        counters.cycles += cycles;
+        counters.instructions += instructions;
+        m_frames[m_currentFrame].cycles += cycles;
+        m_totalCycles += cycles;
+    }
+
+    void CPUProfiler::call(int bank, Address target, Byte returnSP)
+    {
+        //Code that drops its return address and calls again must not nest deeper every time
+        ret(returnSP);
+
+        auto function = location(bank, target);
+        auto it = m_frames[m_currentFrame].callees.find(function);
+        if (it != m_frames[m_currentFrame].callees.end())
+        {
+            m_currentFrame = it->second;
+            //The same callee may be reached with a different stack depth
+            m_frames[m_currentFrame].returnSP = returnSP;
+            return;
+        }
+
+        m_frames.push_back({function, m_currentFrame, returnSP, 0, {}});
+        m_frames[m_currentFrame].callees.emplace(function, m_frames.size() - 1);
+        m_currentFrame = m_frames.size() - 1;
+    }
+
+    void CPUProfiler::ret(Byte sp)
+    {
+        //Returned from every frame whose stack the return has popped
+        while (m_currentFrame && m_frames[m_currentFrame].returnSP <= sp)
+            m_currentFrame = m_frames[m_currentFrame].parent;
+    }
+
+    std::string CPUProfiler::symbol(std::uint32_t location)
+    {
+        std::ostringstream ss;
+        ss << std::hex << std::uppercase << std::setfill('0');
+        int bank = (location >> 16) - 1;
+        if (bank < 0)
+            ss << "--";
+        else
+            ss << std::setw(2) << bank;
+        ss << ':' << std::setw(4) << (location & 0xffff);
+        return ss.str();
+    }
+
+    void CPUProfiler::writeReport(std::ostream& out, std::size_t count)
+    {
+        std::vector<std::pair<std::uint32_t, Counters>> locations (m_locations.begin(), m_locations.end());
+        std::sort(locations.begin(), locations.end(),
+                  [](const std::pair<std::uint32_t, Counters>& a, const std::pair<std::uint32_t, Counters>& b)
+                  { return a.second.cycles > b.second.cycles; });
+        if (locations.size() > count)
+            locations.resize(count);
+
+        out << "Total cycles: " << m_totalCycles << "\n\n"
+            << std::setw(14) << "cycles" << std::setw(9) << "%"
+            << std::setw(14) << "instructions" << "  bank:PC\n";
+        for (const auto& entry : locations)
+        {
+            out << std::setw(14) << entry.second.cycles
+                << std::setw(9) << std::fixed << std::setprecision(2)
+                << (m_totalCycles ? 100.0 * entry.second.cycles / m_totalCycles : 0.0)
+                << std::setw(14) << entry.second.instructions
+                << "  " << symbol(entry.first) << '\n';
+        }
+    }
+
+    void CPUProfiler::writeFoldedStacks(std::ostream& out, std::size_t frame, const std::string& stack)
+    {
+        if (m_frames[frame].cycles)
+            out << stack << ' ' << m_frames[frame].cycles << '\n';
+        for (const auto& callee : m_frames[frame].callees)
+            writeFoldedStacks(out, callee.second, stack + ';' + symbol(callee.first));
+    }
+
+    void CPUProfiler::writeFoldedStacks(std::ostream& out)
+    {
+        writeFoldedStacks(out, 0, "reset");
+    }
+
+    bool CPUProfiler::write(const std::string& reportPath, const std::string& stacksPath)
+    {
+        std::ofstream report (reportPath), stacks (stacksPath);
+        if (!report || !stacks)
+        {
+            LOG(Error) << "Could not open the profile files " << reportPath << " and " << stacksPath << std::endl;
+            return false;
+        }
+
+        writeReport(report);
+        writeFoldedStacks(stacks);
+        LOG(Info) << "Profile written to " << reportPath << " and " << stacksPath << std::endl;
+        return true;
+    }
+}
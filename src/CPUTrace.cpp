@@ -0,0 +1,117 @@
+#include "CPUTrace.h"
+#include "Log.h"
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+
+namespace sn
+{
+    //Written at the start of trace files, the last byte is the version of the record layout
+    static const char TraceMagic[8] = {'S', 'N', 'T', 'R', 'A', 'C', 'E', 1};
+
+    CPUTrace::CPUTrace(std::size_t capacity) :
+        m_buffer(capacity),
+        m_size(0),
+        m_firstPC(0),
+        m_lastPC(0xffff),
+        m_firstFrame(0),
+        m_lastFrame(std::numeric_limits<std::uint32_t>::max())
+    {
+    }
+
+    CPUTrace::~CPUTrace()
+    {
+        flush();
+    }
+
+    bool CPUTrace::open(const std::string& path)
+    {
+        m_file.open(path, std::ios_base::out | std::ios_base::binary);
+        if (!m_file)
+        {
+            LOG(Error) << "Could not open CPU trace file: " << path << std::endl;
+            return false;
+        }
+        m_file.write(TraceMagic, sizeof(TraceMagic));
+        return true;
+    }
+
+    void CPUTrace::setPCRange(Address first, Address last)
+    {
+        m_firstPC = first;
+        m_lastPC = last;
+    }
+
+    void CPUTrace::setFrameRange(std::uint32_t first, std::uint32_t last)
+    {
+        m_firstFrame = first;
+        m_lastFrame = last;
+    }
+
+    void CPUTrace::setFrameCallback(std::function<std::uint32_t(void)> callback)
+    {
+        m_frameCallback = callback;
+    }
+
+    void CPUTrace::record(TraceRecord record)
+    {
+        if (record.pc < m_firstPC || record.pc > m_lastPC)
+            return;
+
+        record.frame = m_frameCallback ? m_frameCallback() : 0;
+        if (record.frame < m_firstFrame || record.frame > m_lastFrame)
+            return;
+
+        m_buffer[m_size++] = record;
+        if (m_size == m_buffer.size())
+            flush();
+    }
+
+    void CPUTrace::flush()
+    {
+        if (m_file.is_open())
+        {
+            m_file.write(reinterpret_cast<const char*>(m_buffer.data()), m_size * sizeof(TraceRecord));
+            m_file.flush();
+        }
+        m_size = 0;
+    }
+
+    void CPUTrace::format(const TraceRecord& record, std::ostream& out)
+    {
+        out << std::hex << std::setfill('0') << std::uppercase
+            << std::setw(4) << +record.pc
+            << "  "
+            << std::setw(2) << +record.opcode
+            << "  "
+            << "A:"   << std::setw(2) << +record.a << " "
+            << "X:"   << std::setw(2) << +record.x << " "
+            << "Y:"   << std::setw(2) << +record.y << " "
+            << "P:"   << std::setw(2) << +record.p << " "
+            << "SP:"  << std::setw(2) << +record.sp << " "
+            << "CYC:" << std::setw(3) << std::setfill(' ') << std::dec << record.cycle * 3 % 341
+            << '\n';
+    }
+
+    bool CPUTrace::decode(const std::string& path, std::ostream& out)
+    {
+        std::ifstream file (path, std::ios_base::in | std::ios_base::binary);
+        char magic[sizeof(TraceMagic)];
+        if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), TraceMagic))
+        {
+            LOG(Error) << "Not a CPU trace file: " << path << std::endl;
+            return false;
+        }
+
+        std::vector<TraceRecord> records (DefaultCapacity);
+        while (file)
+        {
+            file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(TraceRecord));
+            std::size_t count = file.gcount() / sizeof(TraceRecord);
+            for (std::size_t i = 0; i < count; ++i)
+                format(records[i], out);
+        }
+        out.flush();
+        return true;
+    }
+}
@@ -0,0 +1,327 @@
+#include "CPU.h"
+#include "Log.h"
+#include <algorithm>
+#include <utility>
+
+namespace sn
+{
+    //Blocks are translated to micro-ops, operations with their operands resolved to internal RAM, which
+    //runTranslation executes in a switch. No native code is generated: hot code runs without the handler
+    //calls and without any bus access. Translation stops at the first instruction that may touch anything
+    //else (PPU and APU registers, the mapper, cartridge RAM) or changes the control flow; the interpreter
+    //continues from there, so those accesses see the other components exactly as before. A translation
+    //also stops at the translation budget, before the first instruction that starts once the CPU could have
+    //been interrupted, so an interrupt is taken after the same instruction as with the interpreter.
+
+    void CPU::translateBlock(DecodedBlock& block)
+    {
+        block.translated = true;
+
+        for (const auto& decoded : block.instructions)
+        {
+            TranslatedInstruction translated;
+            if (!translateInstruction(decoded, translated))
+                break;
+            block.translation.push_back(translated);
+        }
+    }
+
+    bool CPU::translateInstruction(const DecodedInstruction& decoded, TranslatedInstruction& translated)
+    {
+        //Decoded blocks only exist with instruction accuracy
+        const std::pair<Operation, TranslatedOperation> operations[] = {
+            {&CPU::opLDA<InstructionAccuracy>, TrLDA}, {&CPU::opLDX<InstructionAccuracy>, TrLDX},
+            {&CPU::opLDY<InstructionAccuracy>, TrLDY}, {&CPU::opSTA<InstructionAccuracy>, TrSTA},
+            {&CPU::opSTX<InstructionAccuracy>, TrSTX}, {&CPU::opSTY<InstructionAccuracy>, TrSTY},
+            {&CPU::opORA<InstructionAccuracy>, TrORA}, {&CPU::opAND<InstructionAccuracy>, TrAND},
+            {&CPU::opEOR<InstructionAccuracy>, TrEOR}, {&CPU::opADC<InstructionAccuracy>, TrADC},
+            {&CPU::opSBC<InstructionAccuracy>, TrSBC}, {&CPU::opCMP<InstructionAccuracy>, TrCMP},
+            {&CPU::opCPX<InstructionAccuracy>, TrCPX}, {&CPU::opCPY<InstructionAccuracy>, TrCPY},
+            {&CPU::opBIT<InstructionAccuracy>, TrBIT}, {&CPU::opASL<InstructionAccuracy>, TrASL},
+            {&CPU::opLSR<InstructionAccuracy>, TrLSR}, {&CPU::opROL<InstructionAccuracy>, TrROL},
+            {&CPU::opROR<InstructionAccuracy>, TrROR}, {&CPU::opINC<InstructionAccuracy>, TrINC},
+            {&CPU::opDEC<InstructionAccuracy>, TrDEC},
+            {&CPU::opASLAccumulator, TrASLA}, {&CPU::opLSRAccumulator, TrLSRA},
+            {&CPU::opROLAccumulator, TrROLA}, {&CPU::opRORAccumulator, TrRORA},
+            {&CPU::opTAX, TrTAX}, {&CPU::opTAY, TrTAY}, {&CPU::opTXA, TrTXA},
+            {&CPU::opTYA, TrTYA}, {&CPU::opTSX, TrTSX}, {&CPU::opTXS, TrTXS},
+            {&CPU::opINX, TrINX}, {&CPU::opINY, TrINY}, {&CPU::opDEX, TrDEX},
+            {&CPU::opDEY, TrDEY}, {&CPU::opCLC, TrCLC}, {&CPU::opSEC, TrSEC},
+            {&CPU::opCLD, TrCLD}, {&CPU::opSED, TrSED}, {&CPU::opCLV, TrCLV},
+            {&CPU::opNOP, TrNOP},
+        };
+
+        const Instruction& instruction = *decoded.instruction;
+        auto it = std::find_if(std::begin(operations), std::end(operations),
+                               [&](const std::pair<Operation, TranslatedOperation>& op)
+                               { return op.first == instruction.operation; });
+        if (it == std::end(operations))
+            return false;
+
+        translated.operation = it->second;
+        translated.memory = nullptr;
+        translated.value = 0;
+        translated.cycles = instruction.cycles;
+        translated.length = instruction.length;
+
+        if (instruction.addressing == &CPU::addrImplied)
+            translated.operandMode = NoOperand;
+        else if (instruction.addressing == &CPU::addrImmediate)
+        {
+            //Only operations that read their operand can take an immediate
+            if (translated.operation == TrSTA || translated.operation == TrSTX || translated.operation == TrSTY ||
+                (translated.operation >= TrASL && translated.operation <= TrDEC))
+                return false;
+            translated.operandMode = ImmediateOperand;
+            translated.value = decoded.operand;
+        }
+        else if (instruction.addressing == &CPU::addrZeroPage || instruction.addressing == &CPU::addrAbsolute)
+        {
+            translated.operandMode = MemoryOperand;
+            //Cheats only patch what is read through the bus
+            translated.memory = m_bus.getRAMPtr(decoded.operand);
+            if (!translated.memory || m_bus.isPatched(decoded.operand, decoded.operand))
+                return false;
+        }
+        else if (instruction.addressing == &CPU::addrZeroPageX<InstructionAccuracy> ||
+                 instruction.addressing == &CPU::addrZeroPageY<InstructionAccuracy>)
+        {
+            if (m_bus.isPatched(0x00, 0xff))
+                return false;
+            translated.operandMode = instruction.addressing == &CPU::addrZeroPageX<InstructionAccuracy> ?
+                                     ZeroPageXOperand : ZeroPageYOperand;
+            translated.memory = m_bus.getRAMPtr(0);
+            translated.value = decoded.operand;
+        }
+        else
+            return false;
+
+        return true;
+    }
+
+    Byte* CPU::translatedLocation(const TranslatedInstruction& instruction)
+    {
+        switch (instruction.operandMode)
+        {
+            case ZeroPageXOperand:
+                return instruction.memory + ((instruction.value + r_X) & 0xff);
+            case ZeroPageYOperand:
+                return instruction.memory + ((instruction.value + r_Y) & 0xff);
+            default:
+                return instruction.memory;
+        }
+    }
+
+    Byte CPU::translatedOperand(const TranslatedInstruction& instruction)
+    {
+        if (instruction.operandMode == ImmediateOperand)
+            return instruction.value;
+        return *translatedLocation(instruction);
+    }
+
+    Byte CPU::translatedShift(TranslatedOperation operation, Byte value)
+    {
+        bool prev_C = getFlag(CarryFlag);
+        switch (operation)
+        {
+            case TrASL:
+            case TrASLA:
+                setFlag(CarryFlag, value & 0x80);
+                value <<= 1;
+                break;
+            case TrROL:
+            case TrROLA:
+                setFlag(CarryFlag, value & 0x80);
+                value = value << 1 | prev_C;
+                break;
+            case TrLSR:
+            case TrLSRA:
+                setFlag(CarryFlag, value & 1);
+                value >>= 1;
+                break;
+            default: //ROR
+                setFlag(CarryFlag, value & 1);
+                value = value >> 1 | prev_C << 7;
+                break;
+        }
+        setZN(value);
+        return value;
+    }
+
+    int CPU::runTranslation(const DecodedBlock& block)
+    {
+        int cycles = 0, length = 0;
+        std::size_t count = 0;
+        for (const auto& instruction : block.translation)
+        {
+            if (cycles >= m_translationBudget)
+                break;
+            cycles += instruction.cycles;
+            length += instruction.length;
+            ++count;
+
+            switch (instruction.operation)
+            {
+                case TrLDA: r_A = translatedOperand(instruction); setZN(r_A); break;
+                case TrLDX: r_X = translatedOperand(instruction); setZN(r_X); break;
+                case TrLDY: r_Y = translatedOperand(instruction); setZN(r_Y); break;
+                case TrSTA: *translatedLocation(instruction) = r_A; break;
+                case TrSTX: *translatedLocation(instruction) = r_X; break;
+                case TrSTY: *translatedLocation(instruction) = r_Y; break;
+                case TrORA: r_A |= translatedOperand(instruction); setZN(r_A); break;
+                case TrAND: r_A &= translatedOperand(instruction); setZN(r_A); break;
+                case TrEOR: r_A ^= translatedOperand(instruction); setZN(r_A); break;
+                case TrADC:
+                {
+                    Byte operand = translatedOperand(instruction);
+                    std::uint16_t sum = r_A + operand + getFlag(CarryFlag);
+                    setFlag(CarryFlag, sum & 0x100);
+                    setFlag(OverflowFlag, (r_A ^ sum) & (operand ^ sum) & 0x80);
+                    r_A = static_cast<Byte>(sum);
+                    setZN(r_A);
+                    break;
+                }
+                case TrSBC:
+                {
+                    std::uint16_t subtrahend = translatedOperand(instruction),
+                             diff = r_A - subtrahend - !getFlag(CarryFlag);
+                    setFlag(CarryFlag, !(diff & 0x100));
+                    setFlag(OverflowFlag, (r_A ^ diff) & (~subtrahend ^ diff) & 0x80);
+                    r_A = diff;
+                    setZN(diff);
+                    break;
+                }
+                case TrCMP:
+                case TrCPX:
+                case TrCPY:
+                {
+                    Byte reg = instruction.operation == TrCMP ? r_A : instruction.operation == TrCPX ? r_X : r_Y;
+                    std::uint16_t diff = reg - translatedOperand(instruction);
+                    setFlag(CarryFlag, !(diff & 0x100));
+                    setZN(diff);
+                    break;
+                }
+                case TrBIT:
+                {
+                    Byte operand = translatedOperand(instruction);
+                    setFlag(OverflowFlag, operand & 0x40);
+                    m_resultNZ = (r_A & operand) | (operand & 0x80) << 8;
+                    break;
+                }
+                case TrASL:
+                case TrLSR:
+                case TrROL:
+                case TrROR:
+                {
+                    Byte* location = translatedLocation(instruction);
+                    *location = translatedShift(instruction.operation, *location);
+                    break;
+                }
+                case TrINC: setZN(++*translatedLocation(instruction)); break;
+                case TrDEC: setZN(--*translatedLocation(instruction)); break;
+                case TrASLA:
+                case TrLSRA:
+                case TrROLA:
+                case TrRORA:
+                    r_A = translatedShift(instruction.operation, r_A);
+                    break;
+                case TrTAX: r_X = r_A; setZN(r_X); break;
+                case TrTAY: r_Y = r_A; setZN(r_Y); break;
+                case TrTXA: r_A = r_X; setZN(r_A); break;
+                case TrTYA: r_A = r_Y; setZN(r_A); break;
+                case TrTSX: r_X = r_SP; setZN(r_X); break;
+                case TrTXS: r_SP = r_X; break;
+                case TrINX: setZN(++r_X); break;
+                case TrINY: setZN(++r_Y); break;
+                case TrDEX: setZN(--r_X); break;
+                case TrDEY: setZN(--r_Y); break;
+                case TrCLC: setFlag(CarryFlag, false); break;
+                case TrSEC: setFlag(CarryFlag, true); break;
+                case TrCLD: setFlag(DecimalFlag, false); break;
+                case TrSED: setFlag(DecimalFlag, true); break;
+                case TrCLV: setFlag(OverflowFlag, false); break;
+                case TrNOP: break;
+            }
+        }
+
+        //The interpreter goes on with the rest of the block, if the budget ran out
+        r_PC += length;
+        m_blockPosition = count;
+        m_blockPC = r_PC;
+        m_instructionCount += count;
+        return cycles;
+    }
+
+    CPU::RegisterState CPU::saveRegisters()
+    {
+        return {r_PC, r_A, r_X, r_Y, r_SP, getStatus()};
+    }
+
+    void CPU::restoreRegisters(const RegisterState& state)
+    {
+        r_PC = state.pc;
+        r_A = state.a;
+        r_X = state.x;
+        r_Y = state.y;
+        r_SP = state.sp;
+        setStatus(state.p);
+    }
+
+    bool CPU::sameRegisters(const RegisterState& a, const RegisterState& b)
+    {
+        return a.pc == b.pc && a.a == b.a && a.x == b.x && a.y == b.y && a.sp == b.sp && a.p == b.p;
+    }
+
+    int CPU::verifyTranslation(const DecodedBlock& block)
+    {
+        //Translated blocks only touch the registers and the internal RAM, so both are enough to
+        //rerun the block in the interpreter, which stays the reference
+        const int RAMSize = 0x800;
+        Byte* ram = m_bus.getRAMPtr(0);
+        std::vector<Byte> startRAM (ram, ram + RAMSize);
+        RegisterState start = saveRegisters();
+        auto instructionCount = m_instructionCount;
+
+        //Neither may go through the bus handlers, which would mean an access to anything but memory
+        auto handlerAccesses = m_bus.getHandlerAccesses();
+        int translatedCycles = runTranslation(block);
+        auto translatedAccesses = m_bus.getHandlerAccesses() - handlerAccesses;
+        RegisterState translated = saveRegisters();
+        std::vector<Byte> translatedRAM (ram, ram + RAMSize);
+
+        std::copy(startRAM.begin(), startRAM.end(), ram);
+        restoreRegisters(start);
+        m_instructionCount = instructionCount;
+
+        //The interpreter is stepped through on its own, up to the last instruction starting within the budget
+        handlerAccesses = m_bus.getHandlerAccesses();
+        int instructionCycles = m_instructionCycles;
+        std::size_t count = 0;
+        while (count < block.translation.size() && m_instructionCycles - instructionCycles < m_translationBudget)
+            executeDecoded(block.instructions[count++]);
+        int cycles = m_instructionCycles - instructionCycles;
+        auto accesses = m_bus.getHandlerAccesses() - handlerAccesses;
+        m_instructionCycles = instructionCycles;
+        m_blockPosition = count;
+        m_blockPC = r_PC;
+
+        RegisterState expected = saveRegisters();
+        if (!sameRegisters(expected, translated) || !std::equal(translatedRAM.begin(), translatedRAM.end(), ram) ||
+            cycles != translatedCycles || accesses || translatedAccesses)
+        {
+            LOG(Error) << "Translation mismatch in block at " << std::hex << +start.pc
+                       << ": PC " << +translated.pc << "/" << +expected.pc
+                       << " A " << +translated.a << "/" << +expected.a
+                       << " X " << +translated.x << "/" << +expected.x
+                       << " Y " << +translated.y << "/" << +expected.y
+                       << " SP " << +translated.sp << "/" << +expected.sp
+                       << " P " << +translated.p << "/" << +expected.p
+                       << std::dec << " cycles " << translatedCycles << "/" << cycles
+                       << " I/O accesses " << translatedAccesses << "/" << accesses
+                       << (std::equal(translatedRAM.begin(), translatedRAM.end(), ram) ? "" : ", RAM differs")
+                       << std::endl;
+        }
+
+        return cycles;
+    }
+}
@@ -0,0 +1,130 @@
+#include "Cheats.h"
+#include "Log.h"
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+namespace sn
+{
+    bool Cheats::add(const std::string& code)
+    {
+        Patch patch;
+        bool valid = code.find('=') != std::string::npos ? decodeRaw(code, patch) : decodeGameGenie(code, patch);
+        if (!valid)
+            return false;
+
+        //Registers are left alone, reading them has side effects the patch would hide
+        if (patch.addr >= 0x2000 && patch.addr < 0x6000)
+        {
+            LOG(Error) << "Cheats can only patch RAM and PRG-ROM: " << code << std::endl;
+            return false;
+        }
+        patch.addr = normalize(patch.addr);
+        m_patches.push_back(patch);
+        return true;
+    }
+
+    bool Cheats::loadFromFile(const std::string& path)
+    {
+        std::ifstream file (path);
+        if (!file)
+            return false;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::stringstream ss (line);
+            std::string code;
+            if (!(ss >> code) || code[0] == '#')
+                continue;
+            if (!add(code))
+            {
+                LOG(Error) << "Invalid cheat code in " << path << ": " << code << std::endl;
+            }
+        }
+        LOG(Info) << "Cheats loaded from " << path << ": " << m_patches.size() << std::endl;
+        return true;
+    }
+
+    bool Cheats::patches(Address first, Address last)
+    {
+        first = normalize(first);
+        last = normalize(last);
+        for (const auto& patch : m_patches)
+        {
+            if (patch.addr >= first && patch.addr <= last)
+                return true;
+        }
+        return false;
+    }
+
+    Byte Cheats::apply(Address addr, Byte value)
+    {
+        addr = normalize(addr);
+        for (const auto& patch : m_patches)
+        {
+            if (patch.addr == addr && (patch.compare < 0 || patch.compare == value))
+                return patch.value;
+        }
+        return value;
+    }
+
+    std::string Cheats::getPath(const std::string& rom_path)
+    {
+        auto extension = rom_path.find_last_of('.');
+        if (extension == std::string::npos || rom_path.find_first_of("/\\", extension) != std::string::npos)
+            extension = rom_path.size();
+        return rom_path.substr(0, extension) + ".cht";
+    }
+
+    bool Cheats::decodeGameGenie(const std::string& code, Patch& patch)
+    {
+        //Each letter stands for 4 bits, scrambled into the address, the value and the compare
+        const std::string letters = "APZLGITYEOXUKSVN";
+        if (code.size() != 6 && code.size() != 8)
+            return false;
+
+        int n[8];
+        for (std::size_t i = 0; i < code.size(); ++i)
+        {
+            auto position = letters.find(std::toupper(static_cast<unsigned char>(code[i])));
+            if (position == std::string::npos)
+                return false;
+            n[i] = position;
+        }
+
+        patch.addr = 0x8000 | ((n[3] & 7) << 12) | ((n[5] & 7) << 8) | ((n[4] & 8) << 8) |
+                     ((n[2] & 7) << 4) | ((n[1] & 8) << 4) | (n[4] & 7) | (n[3] & 8);
+        patch.value = ((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7);
+        if (code.size() == 6)
+        {
+            patch.value |= n[5] & 8;
+            patch.compare = -1;
+        }
+        else
+        {
+            patch.value |= n[7] & 8;
+            patch.compare = ((n[7] & 7) << 4) | ((n[6] & 8) << 4) | (n[6] & 7) | (n[5] & 8);
+        }
+        return true;
+    }
+
+    bool Cheats::decodeRaw(const std::string& code, Patch& patch)
+    {
+        unsigned int addr, value, compare = 0;
+        char separator;
+        std::stringstream ss (code);
+        if (!(ss >> std::hex >> addr >> separator))
+            return false;
+        bool hasCompare = separator == '?';
+        if (hasCompare && !(ss >> compare >> separator))
+            return false;
+        if (separator != '=' || !(ss >> value) || !ss.eof() || addr > 0xffff || value > 0xff || compare > 0xff)
+            return false;
+
+        patch.addr = addr;
+        patch.value = value;
+        patch.compare = hasCompare ? static_cast<int>(compare) : -1;
+        return true;
+    }
+}
@@ -2,76 +2,48 @@
 #include "CPUOpcodes.h"
 #include "Log.h"
 
-#include <thread>
+#include <iomanip>
+#include <sstream>
 #include <chrono>
 
 namespace sn
 {
-    Emulator::Emulator() :
-        m_cpu(m_bus),
-        m_ppu(m_pictureBus, m_emulatorScreen),
-        m_screenScale(3.f),
-        m_cycleTimer(),
-        m_cpuCycleDuration(std::chrono::nanoseconds(559))
-    {
-        if(!m_bus.setReadCallback(PPUSTATUS, [&](void) {return m_ppu.getStatus();}) ||
-            !m_bus.setReadCallback(PPUDATA, [&](void) {return m_ppu.getData();}) ||
-            !m_bus.setReadCallback(JOY1, [&](void) {return m_controller1.read();}) ||
-            !m_bus.setReadCallback(JOY2, [&](void) {return m_controller2.read();}) ||
-            !m_bus.setReadCallback(OAMDATA, [&](void) {return m_ppu.getOAMData();}))
-        {
-            LOG(Error) << "Critical error: Failed to set I/O callbacks" << std::endl;
-        }
-
+    //Rate at which fast-forward shows the frames, and reports its speed
+    const std::chrono::duration<double> PresentInterval (1 / 60.0);
+    const std::chrono::duration<double> SpeedReportInterval (1.0);
 
-        if(!m_bus.setWriteCallback(PPUCTRL, [&](Byte b) {m_ppu.control(b);}) ||
-            !m_bus.setWriteCallback(PPUMASK, [&](Byte b) {m_ppu.setMask(b);}) ||
-            !m_bus.setWriteCallback(OAMADDR, [&](Byte b) {m_ppu.setOAMAddress(b);}) ||
-            !m_bus.setWriteCallback(PPUADDR, [&](Byte b) {m_ppu.setDataAddress(b);}) ||
-            !m_bus.setWriteCallback(PPUSCROL, [&](Byte b) {m_ppu.setScroll(b);}) ||
-            !m_bus.setWriteCallback(PPUDATA, [&](Byte b) {m_ppu.setData(b);}) ||
-            !m_bus.setWriteCallback(OAMDMA, [&](Byte b) {DMA(b);}) ||
-            !m_bus.setWriteCallback(JOY1, [&](Byte b) {m_controller1.strobe(b); m_controller2.strobe(b);}) ||
-            !m_bus.setWriteCallback(OAMDATA, [&](Byte b) {m_ppu.setOAMData(b);}))
-        {
-            LOG(Error) << "Critical error: Failed to set I/O callbacks" << std::endl;
-        }
-
-        m_ppu.setInterruptCallback([&](){ m_cpu.interrupt(InterruptType::NMI); });
+    Emulator::Emulator() :
+        m_frames(Framebuffer(NESVideoWidth * NESVideoHeight, sf::Color::White)),
+        m_buttons(0),
+        m_running(false),
+        m_paused(false),
+        m_fastForward(false),
+        m_break(false),
+        m_framesToStep(0),
+        m_fastForwardSpeed(0),
+        m_runAhead(0),
+        m_fastForwardFrames(0),
+        m_screenScale(3.f)
+    {
     }
 
     void Emulator::run(std::string rom_path)
     {
-        if (!m_cartridge.loadFromFile(rom_path))
-            return;
-
-        m_mapper = Mapper::createMapper(static_cast<Mapper::Type>(m_cartridge.getMapper()),
-                                        m_cartridge,
-                                        [&](){ m_cpu.interrupt(InterruptType::IRQ); },
-                                        [&](){ m_pictureBus.updateMirroring(); });
-        if (!m_mapper)
-        {
-            LOG(Error) << "Creating Mapper failed. Probably unsupported." << std::endl;
+        if (!m_core.loadRom(rom_path))
             return;
-        }
-
-        if (!m_bus.setMapper(m_mapper.get()) ||
-            !m_pictureBus.setMapper(m_mapper.get()))
-            return;
-
-        m_cpu.reset();
-        m_ppu.reset();
 
         m_window.create(sf::VideoMode(NESVideoWidth * m_screenScale, NESVideoHeight * m_screenScale),
                         "SimpleNES", sf::Style::Titlebar | sf::Style::Close | sf::Style::Resize);
+        //Waiting for the display only holds up this thread, the emulation is paced on its own
         m_window.setVerticalSyncEnabled(true);
         m_emulatorScreen.create(NESVideoWidth, NESVideoHeight, m_screenScale, sf::Color::White);
 
-        m_cycleTimer = std::chrono::high_resolution_clock::now();
-        m_elapsedTime = m_cycleTimer - m_cycleTimer;
+        m_running = true;
+        m_emulationThread = std::thread(&Emulator::emulate, this);
 
         sf::Event event;
         bool focus = true, pause = false;
+        float speed = 0;
         while (m_window.isOpen())
         {
             while (m_window.pollEvent(event))
@@ -80,13 +52,9 @@ namespace sn
                 (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape))
                 {
                     m_window.close();
-                    return;
                 }
                 else if (event.type == sf::Event::GainedFocus)
-                {
                     focus = true;
-                    m_cycleTimer = std::chrono::high_resolution_clock::now();
-                }
                 else if (event.type == sf::Event::LostFocus)
                     focus = false;
                 else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F2)
@@ -94,7 +62,7 @@ namespace sn
                     pause = !pause;
                     if (!pause)
                     {
-                        m_cycleTimer = std::chrono::high_resolution_clock::now();
+                        m_break = false;
                         LOG(Info) << "Paused." << std::endl;
                     }
                     else
@@ -104,15 +72,11 @@ namespace sn
                 }
                 else if (pause && event.type == sf::Event::KeyReleased && event.key.code == sf::Keyboard::F3)
                 {
-                    for (int i = 0; i < 29781; ++i) //Around one frame
-                    {
-                        //PPU
-                        m_ppu.step();
-                        m_ppu.step();
-                        m_ppu.step();
-                        //CPU
-                        m_cpu.step();
-                    }
+                    ++m_framesToStep;
+                }
+                else if (focus && event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Tab)
+                {
+                    setFastForward(!m_fastForward);
                 }
                 else if (focus && event.type == sf::Event::KeyReleased && event.key.code == sf::Keyboard::F4)
                 {
@@ -123,47 +87,247 @@ namespace sn
                     Log::get().setLevel(InfoVerbose);
                 }
             }
+            if (!m_window.isOpen())
+                break;
 
-            if (focus && !pause)
+            m_buttons = readKeys(m_keys1) | readKeys(m_keys2) << 8;
+            //The emulation thread already stopped on its own, it stays paused like with F2
+            if (m_break && !pause)
             {
-                m_elapsedTime += std::chrono::high_resolution_clock::now() - m_cycleTimer;
-                m_cycleTimer = std::chrono::high_resolution_clock::now();
+                pause = true;
+                LOG(Info) << "Paused at watchpoint hit, F2 to resume, F3 to finish the frame" << std::endl;
+            }
+            m_paused = pause || !focus;
 
-                while (m_elapsedTime > m_cpuCycleDuration)
-                {
-                    //PPU
-                    m_ppu.step();
-                    m_ppu.step();
-                    m_ppu.step();
-                    //CPU
-                    m_cpu.step();
-
-                    m_elapsedTime -= m_cpuCycleDuration;
-                }
+            if (m_fastForwardSpeed != speed)
+            {
+                speed = m_fastForwardSpeed;
+                std::ostringstream ss;
+                ss << "SimpleNES";
+                if (speed > 0)
+                    ss << " - Fast-forward " << std::fixed << std::setprecision(1) << speed << "x";
+                m_window.setTitle(ss.str());
+            }
 
+            if (m_frames.update())
+            {
+                updateScreen(m_frames.front());
                 m_window.draw(m_emulatorScreen);
                 m_window.display();
             }
             else
             {
-                sf::sleep(sf::milliseconds(1000/60));
-                //std::this_thread::sleep_for(std::chrono::milliseconds(1000/60)); //1/60 second
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
         }
+
+        m_running = false;
+        m_emulationThread.join();
+        m_pacer.logStats();
     }
 
-    void Emulator::DMA(Byte page)
+    void Emulator::emulate()
     {
-        m_cpu.skipDMACycles();
-        auto page_ptr = m_bus.getPagePtr(page);
-        if (page_ptr != nullptr)
+        bool paused = true, fastForwarding = false;
+        while (m_running)
         {
-            m_ppu.doDMA(page_ptr);
+            if (m_paused || m_break)
+            {
+                paused = true;
+                if (m_framesToStep > 0)
+                {
+                    --m_framesToStep;
+                    runFrames(1);
+                }
+                else
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            //Back to real time after stopping, instead of making up for the time lost or the frames run ahead
+            if (paused || fastForwarding != m_fastForward)
+            {
+                if (fastForwarding)
+                    reportSpeed();
+                fastForwarding = m_fastForward;
+                m_fastForwardSpeed = 0;
+                paused = false;
+                resume();
+            }
+
+            if (fastForwarding)
+            {
+                fastForward();
+            }
+            else
+            {
+                runFrames(m_pacer.framesDue());
+                m_pacer.waitForNextFrame();
+            }
+        }
+    }
+
+    void Emulator::runFrames(int frames)
+    {
+        if (!frames)
+            return;
+
+        auto idleCycles = m_core.getIdleCycles();
+        //Only the frame shown is drawn and run ahead
+        bool complete = true;
+        for (int i = 1; i < frames && complete; ++i)
+            complete = runFrame(false);
+        if (complete)
+            runFrame(true, m_runAhead);
+        LOG(InfoVerbose) << "Idle loop cycles skipped: " << m_core.getIdleCycles() - idleCycles << std::endl;
+
+        publish();
+    }
+
+    void Emulator::fastForward()
+    {
+        //Only one frame for each interval is drawn, the one handed to the window
+        auto start = FramePacer::Clock::now();
+        bool complete = true;
+        while (complete && FramePacer::Clock::now() - start < PresentInterval)
+        {
+            complete = runFrame(false);
+            ++m_fastForwardFrames;
         }
+        if (complete)
+        {
+            runFrame(true);
+            ++m_fastForwardFrames;
+        }
+        publish();
+
+        if (FramePacer::Clock::now() - m_fastForwardStart >= SpeedReportInterval)
+            reportSpeed();
+    }
+
+    bool Emulator::runFrame(bool render, int runAhead)
+    {
+        std::uint16_t buttons = m_buttons;
+        if (render)
+            m_core.runFrameAhead(buttons, buttons >> 8, runAhead);
         else
+            m_core.runFrame(buttons, buttons >> 8, false);
+
+        if (m_core.isStopped())
         {
-            LOG(Error) << "Can't get pageptr for DMA" << std::endl;
+            m_break = true;
+            return false;
         }
+        return true;
+    }
+
+    void Emulator::publish()
+    {
+        m_frames.back() = m_core.framebuffer();
+        m_frames.publish();
+    }
+
+    void Emulator::resume()
+    {
+        m_pacer.reset();
+        m_fastForwardFrames = 0;
+        m_fastForwardStart = FramePacer::Clock::now();
+    }
+
+    void Emulator::reportSpeed()
+    {
+        std::chrono::duration<double> elapsed = FramePacer::Clock::now() - m_fastForwardStart;
+        if (m_fastForwardFrames && elapsed.count() > 0)
+        {
+            double speed = m_fastForwardFrames / elapsed.count() / NTSCFrameRate;
+            LOG(Info) << "Fast-forward: " << m_fastForwardFrames << " frames in " << elapsed.count() << "s, "
+                      << speed << "x speed" << std::endl;
+            m_fastForwardSpeed = speed;
+        }
+        m_fastForwardFrames = 0;
+        m_fastForwardStart = FramePacer::Clock::now();
+    }
+
+    void Emulator::setFastForward(bool fastForward)
+    {
+        if (m_fastForward == fastForward)
+            return;
+        m_fastForward = fastForward;
+        LOG(Info) << "Fast-forward " << (fastForward ? "on" : "off") << std::endl;
+    }
+
+    Byte Emulator::readKeys(const std::vector<sf::Keyboard::Key>& keys)
+    {
+        Byte buttons = 0;
+        for (std::size_t button = 0; button < keys.size() && button < Controller::TotalButtons; ++button)
+            buttons |= sf::Keyboard::isKeyPressed(keys[button]) << button;
+        return buttons;
+    }
+
+    void Emulator::updateScreen(const Framebuffer& picture)
+    {
+        for (int x = 0; x < NESVideoWidth; ++x)
+        {
+            for (int y = 0; y < NESVideoHeight; ++y)
+            {
+                m_emulatorScreen.setPixel(x, y, picture[y * NESVideoWidth + x]);
+            }
+        }
+    }
+
+    void Emulator::benchmark(std::string rom_path, int frames)
+    {
+        if (!m_core.loadRom(rom_path))
+            return;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < frames;)
+        {
+            m_core.runFrameAhead(0, 0, m_runAhead);
+            //A watchpoint hit only stops the frame, it is carried on with
+            if (!m_core.isStopped())
+                ++i;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        auto seconds = elapsed.count();
+        if (m_runAhead > 0)
+        {
+            LOG(Info) << "Benchmark run " << m_runAhead << " frames ahead of each frame" << std::endl;
+        }
+        LOG(Info) << "Benchmark (mapper " << m_core.getMapperType() << "): " << frames << " frames in " << seconds << "s, "
+                  << frames / seconds << " frames/s, "
+                  << m_core.getInstructionCount() / seconds / 1e6 << " million instructions/s, "
+                  << m_core.getIdleCycles() / frames << " idle loop cycles skipped per frame" << std::endl;
+    }
+
+    bool Emulator::verifyAccuracy(std::string rom_path, int frames)
+    {
+        //The reference runs until the same time as the core, the end of its frame. Anything the core
+        //does at the wrong cycle shows up as a difference sooner or later. The reference's PPU is stepped
+        //on every CPU cycle, without the lazy catching up of the core, so the pictures of both are compared
+        //through their hashes as well
+        std::unique_ptr<EmulatorCore> reference (new EmulatorCore());
+        reference->setAccuracy(CycleAccuracy);
+        if (!m_core.loadRom(rom_path) || !reference->loadRom(rom_path))
+            return false;
+
+        for (int i = 0; i < frames; ++i)
+        {
+            m_core.runFrame(0, 0);
+            reference->runUntil(m_core.getTime());
+            if (!m_core.isInSameState(*reference))
+            {
+                LOG(Error) << "Differs from the cycle accurate CPU at the end of frame " << i
+                           << " (frame hash " << std::hex << m_core.getFrameHash() << ", cycle accurate "
+                           << reference->getFrameHash() << std::dec
+                           << "), compare the traces of both with --log-cpu to find where" << std::endl;
+                return false;
+            }
+        }
+        LOG(Info) << "Same as the cycle accurate CPU for " << frames << " frames, last frame hash "
+                  << std::hex << m_core.getFrameHash() << std::dec << std::endl;
+        return true;
     }
 
     void Emulator::setVideoHeight(int height)
@@ -173,6 +337,31 @@ namespace sn
                   << int(NESVideoWidth * m_screenScale) << "x" << int(NESVideoHeight * m_screenScale) << std::endl;
     }
 
+    void Emulator::setTranslation(TranslationMode mode)
+    {
+        m_core.setTranslation(mode);
+    }
+
+    void Emulator::setAccuracy(CPUAccuracy accuracy)
+    {
+        m_core.setAccuracy(accuracy);
+    }
+
+    void Emulator::setCPUTrace(CPUTrace* trace)
+    {
+        m_core.setCPUTrace(trace);
+    }
+
+    void Emulator::setCPUProfiler(CPUProfiler* profiler)
+    {
+        m_core.setCPUProfiler(profiler);
+    }
+
+    void Emulator::setWatchpoints(Watchpoints* watchpoints)
+    {
+        m_core.setWatchpoints(watchpoints);
+    }
+
     void Emulator::setVideoWidth(int width)
     {
         m_screenScale = width / float(NESVideoWidth);
@@ -187,10 +376,16 @@ namespace sn
                   << int(NESVideoWidth * m_screenScale) << "x" << int(NESVideoHeight * m_screenScale) << std::endl;
     }
 
+    void Emulator::setRunAhead(int frames)
+    {
+        m_runAhead = frames;
+        LOG(Info) << "Running " << frames << " frames ahead" << std::endl;
+    }
+
     void Emulator::setKeys(std::vector<sf::Keyboard::Key>& p1, std::vector<sf::Keyboard::Key>& p2)
     {
-        m_controller1.setKeyBindings(p1);
-        m_controller2.setKeyBindings(p2);
+        m_keys1 = p1;
+        m_keys2 = p2;
     }
 
 }
@@ -0,0 +1,327 @@
+#include "EmulatorCore.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace sn
+{
+    //The PPU is only caught up with the CPU when the program accesses it
+    template <Byte (PPU::*read)()>
+    Byte EmulatorCore::readPPU()
+    {
+        syncPPUForAccess(false);
+        return (m_ppu.*read)();
+    }
+
+    template <void (PPU::*write)(Byte)>
+    void EmulatorCore::writePPU(Byte value)
+    {
+        syncPPUForAccess(true);
+        (m_ppu.*write)(value);
+        updatePPUDeadline();
+    }
+
+    EmulatorCore::EmulatorCore() :
+        m_cpu(m_bus),
+        m_ppu(m_pictureBus),
+        m_ppuTime(0),
+        m_ppuDeadline(0),
+        m_frameComplete(false),
+        m_watchpoints(nullptr),
+        m_stopped(false)
+    {
+        if(!m_bus.setReadHandler<EmulatorCore, &EmulatorCore::readPPU<&PPU::getStatus>>(PPUSTATUS, this) ||
+            !m_bus.setReadHandler<EmulatorCore, &EmulatorCore::readPPU<&PPU::getData>>(PPUDATA, this) ||
+            !m_bus.setReadHandler<Controller, &Controller::read>(JOY1, &m_controller1) ||
+            !m_bus.setReadHandler<Controller, &Controller::read>(JOY2, &m_controller2) ||
+            !m_bus.setReadHandler<EmulatorCore, &EmulatorCore::readPPU<&PPU::getOAMData>>(OAMDATA, this))
+        {
+            LOG(Error) << "Critical error: Failed to set I/O callbacks" << std::endl;
+        }
+
+
+        if(!m_bus.setWriteHandler<EmulatorCore, &EmulatorCore::writePPU<&PPU::control>>(PPUCTRL, this) ||
+            !m_bus.setWriteHandler<EmulatorCore, &EmulatorCore::writePPU<&PPU::setMask>>(PPUMASK, this) ||
+            !m_bus.setWriteHandler<EmulatorCore, &EmulatorCore::writePPU<&PPU::setOAMAddress>>(OAMADDR, this) ||
+            !m_bus.setWriteHandler<EmulatorCore, &EmulatorCore::writePPU<&PPU::setDataAddress>>(PPUADDR, this) ||
+            !m_bus.setWriteHandler<EmulatorCore, &EmulatorCore::writePPU<&PPU::setScroll>>(PPUSCROL, this) ||
+            !m_bus.setWriteHandler<EmulatorCore, &EmulatorCore::writePPU<&PPU::setData>>(PPUDATA, this) ||
+            !m_bus.setWriteHandler<EmulatorCore, &EmulatorCore::DMA>(OAMDMA, this) ||
+            !m_bus.setWriteHandler<EmulatorCore, &EmulatorCore::strobeControllers>(JOY1, this) ||
+            !m_bus.setWriteHandler<EmulatorCore, &EmulatorCore::writePPU<&PPU::setOAMData>>(OAMDATA, this))
+        {
+            LOG(Error) << "Critical error: Failed to set I/O callbacks" << std::endl;
+        }
+        m_bus.setMapperWriteCallback([&](){ syncPPUForAccess(true); });
+
+        m_ppu.setInterruptCallback([&](){ m_cpu.interrupt(InterruptType::NMI); });
+        m_ppu.setFrameCallback([&](){ m_frameComplete = true; });
+        //A cycle accurate CPU keeps the PPU in step on its own
+        m_cpu.setCycleCallback([&](){ m_ppu.run(DotsPerCPUCycle); m_ppuTime += DotsPerCPUCycle; });
+        //The mapper's scanline counters are clocked by the PPU, so they are covered by its events
+        m_scheduler.addComponent([&](){ return m_ppu.getEventHorizon(); });
+    }
+
+    bool EmulatorCore::loadRom(const std::string& rom_path)
+    {
+        if (!m_cartridge.loadFromFile(rom_path))
+            return false;
+
+        m_mapper = Mapper::createMapper(static_cast<Mapper::Type>(m_cartridge.getMapper()),
+                                        m_cartridge,
+                                        [&](){ m_cpu.interrupt(InterruptType::IRQ); },
+                                        [&](){ m_pictureBus.updateMirroring(); });
+        if (!m_mapper)
+        {
+            LOG(Error) << "Creating Mapper failed. Probably unsupported." << std::endl;
+            return false;
+        }
+        m_mapper->setPRGBankCallback([&](){ m_bus.updatePRGPages(); m_cpu.updatePRGBanks(); });
+        m_mapper->setCHRBankCallback([&](){ m_pictureBus.updateCHRPages(); });
+
+        if (!m_bus.setMapper(m_mapper.get()) ||
+            !m_pictureBus.setMapper(m_mapper.get()))
+            return false;
+
+        //Cheats are optional, a ROM without a file of them just has none
+        m_cheats.clear();
+        m_cheats.loadFromFile(Cheats::getPath(rom_path));
+        m_bus.setCheats(m_cheats.empty() ? nullptr : &m_cheats);
+
+        m_ppu.reset();
+        m_cpu.reset();
+        m_scheduler.reset();
+        m_ppuTime = 0;
+        updatePPUDeadline();
+        m_runAheadState.clear();
+        return true;
+    }
+
+    void EmulatorCore::runFrame(Byte buttons1, Byte buttons2, bool render)
+    {
+        setButtons(buttons1, buttons2);
+        m_ppu.setRenderSkip(!render);
+
+        //The end of the picture is one of the PPU's events, so it is caught up with in time for it.
+        //A frame stopped by a watchpoint is carried on with, even if the instruction that hit it completed it
+        if (!m_stopped)
+            m_frameComplete = false;
+        m_stopped = false;
+        while (!m_frameComplete && !m_stopped)
+            m_scheduler.advance(stepInstruction(std::numeric_limits<Timestamp>::max()) * DotsPerCPUCycle);
+        //Catching up the PPU of a stopped frame could complete it before its time
+        if (!m_stopped)
+            syncPPU(m_scheduler.getTime());
+    }
+
+    void EmulatorCore::runFrameAhead(Byte buttons1, Byte buttons2, int frames)
+    {
+        if (m_watchpoints)
+            frames = 0;
+        runFrame(buttons1, buttons2, frames <= 0);
+        if (frames <= 0)
+            return;
+
+        saveState(m_runAheadState);
+        for (int i = 0; i < frames; ++i)
+            runFrame(buttons1, buttons2, i == frames - 1);
+        loadState(m_runAheadState);
+    }
+
+    void EmulatorCore::runUntil(Timestamp time)
+    {
+        m_ppu.setRenderSkip(false);
+        m_stopped = false;
+        while (m_scheduler.getTime() < time && !m_stopped)
+            m_scheduler.advance(stepInstruction(time) * DotsPerCPUCycle);
+        //The frame is shown, finish what the PPU has drawn so far
+        syncPPU(m_scheduler.getTime());
+    }
+
+    void EmulatorCore::setButtons(Byte buttons1, Byte buttons2)
+    {
+        m_controller1.setButtons(buttons1);
+        m_controller2.setButtons(buttons2);
+    }
+
+    void EmulatorCore::saveState(Snapshot& snapshot)
+    {
+        snapshot.clear();
+        m_mapper->saveState(snapshot);
+        m_bus.saveState(snapshot);
+        m_pictureBus.saveState(snapshot);
+        m_cpu.saveState(snapshot);
+        m_ppu.saveState(snapshot);
+        m_controller1.saveState(snapshot);
+        m_controller2.saveState(snapshot);
+        m_scheduler.saveState(snapshot);
+        snapshot.save(m_ppuTime);
+        snapshot.save(m_ppuDeadline);
+        snapshot.save(m_frameComplete);
+    }
+
+    void EmulatorCore::loadState(Snapshot& snapshot)
+    {
+        snapshot.rewind();
+        m_mapper->loadState(snapshot);
+        m_bus.loadState(snapshot);
+        m_pictureBus.loadState(snapshot);
+        m_cpu.loadState(snapshot);
+        m_ppu.loadState(snapshot);
+        m_controller1.loadState(snapshot);
+        m_controller2.loadState(snapshot);
+        m_scheduler.loadState(snapshot);
+        snapshot.load(m_ppuTime);
+        snapshot.load(m_ppuDeadline);
+        snapshot.load(m_frameComplete);
+    }
+
+    bool EmulatorCore::isInSameState(EmulatorCore& other)
+    {
+        return getTime() == other.getTime() && m_cpu.isInSameState(other.m_cpu) &&
+               std::equal(m_bus.getRAMPtr(0), m_bus.getRAMPtr(0) + 0x800, other.m_bus.getRAMPtr(0)) &&
+               m_ppu.getFrame() == other.m_ppu.getFrame() && framebuffer() == other.framebuffer();
+    }
+
+    std::uint64_t EmulatorCore::getFrameHash()
+    {
+        std::uint64_t hash = 0xcbf29ce484222325;
+        for (const auto& color : framebuffer())
+        {
+            for (Byte component : {color.r, color.g, color.b})
+                hash = (hash ^ component) * 0x100000001b3;
+        }
+        return hash;
+    }
+
+    void EmulatorCore::syncPPU(Timestamp time)
+    {
+        //A cycle accurate CPU runs the PPU itself on every cycle, the PPU never lags behind to be caught up.
+        //Nothing of the catching up and its deadlines is used then, which keeps it an independent reference
+        if (time <= m_ppuTime || m_cpu.getAccuracy() == CycleAccuracy)
+            return;
+        m_ppu.run(time - m_ppuTime);
+        m_ppuTime = time;
+        updatePPUDeadline();
+    }
+
+    void EmulatorCore::syncPPUForAccess(bool write)
+    {
+        //The PPU is run for the cycle of the access before it. With cycle accuracy it is there already
+        syncPPU(m_scheduler.getTime() + m_cpu.getAccessCycle(write) * DotsPerCPUCycle);
+    }
+
+    void EmulatorCore::updatePPUDeadline()
+    {
+        m_ppuDeadline = m_ppuTime + m_ppu.getInterruptHorizon();
+    }
+
+    int EmulatorCore::stepInstruction(Timestamp limit)
+    {
+        //The CPU runs the PPU on its own, before every bus access
+        if (m_cpu.getAccuracy() == CycleAccuracy)
+            return m_cpu.run(1);
+
+        //An interrupt the PPU raised by now has to be pending before the CPU goes on
+        if (m_scheduler.getTime() > m_ppuDeadline)
+            syncPPU(m_scheduler.getTime());
+
+        //An idle loop can't change anything until another component does, so its iterations up to the next event
+        //are skipped at once. Only whole iterations are skipped, the CPU ends up exactly where it would have
+        int idleCycles = m_cpu.getIdleLoopCycles();
+        if (idleCycles)
+        {
+            //The events are counted from where the PPU is now. The skipped dots are left to the next catch-up
+            syncPPU(m_scheduler.getTime());
+            if (!m_cpu.isIdleLoopPollingStatus() || m_ppu.isStatusUnchanged())
+            {
+                Timestamp horizon = std::min<Timestamp>(m_scheduler.getEventHorizon(), limit - m_scheduler.getTime());
+                int iterations = horizon / (idleCycles * DotsPerCPUCycle);
+                if (iterations > 0)
+                {
+                    m_cpu.skipIdleLoop(iterations);
+                    return iterations * idleCycles;
+                }
+            }
+        }
+
+        //Unless an interrupt is due the PPU is left behind, to be caught up by the next access to it. One raised
+        //while the instruction executes is taken after it, on the next step, like the cycle accurate CPU does.
+        //A translated block runs its instructions starting before the deadline is passed or the limit reached
+        Timestamp end = std::min<Timestamp>(limit, m_ppuDeadline + 1);
+        m_cpu.setTranslationBudget((end - m_scheduler.getTime() + DotsPerCPUCycle - 1) / DotsPerCPUCycle);
+        return m_cpu.run(1);
+    }
+
+    void EmulatorCore::strobeControllers(Byte value)
+    {
+        m_controller1.strobe(value);
+        m_controller2.strobe(value);
+    }
+
+    void EmulatorCore::DMA(Byte page)
+    {
+        syncPPUForAccess(true);
+        m_cpu.skipDMACycles();
+        auto page_ptr = m_bus.getPagePtr(page);
+        if (page_ptr != nullptr)
+        {
+            m_ppu.doDMA(page_ptr);
+        }
+        else
+        {
+            LOG(Error) << "Can't get pageptr for DMA" << std::endl;
+        }
+    }
+
+    void EmulatorCore::setTranslation(TranslationMode mode)
+    {
+        m_cpu.setTranslation(mode);
+        if (mode == TranslationVerify)
+        {
+            LOG(Info) << "Micro-op translation enabled, verifying translated blocks against the interpreter" << std::endl;
+        }
+        else if (mode == TranslationOn)
+        {
+            LOG(Info) << "Micro-op translation enabled" << std::endl;
+        }
+    }
+
+    void EmulatorCore::setAccuracy(CPUAccuracy accuracy)
+    {
+        m_cpu.setAccuracy(accuracy);
+        if (accuracy == CycleAccuracy)
+        {
+            LOG(Info) << "Cycle accurate CPU, block cache, micro-op translation and idle loop skipping disabled" << std::endl;
+        }
+    }
+
+    void EmulatorCore::setCPUTrace(CPUTrace* trace)
+    {
+        //Every instruction starts with the PPU caught up to its next event at least, and the frame only ends
+        //on one, so the PPU has already counted the frame without catching it up any further
+        trace->setFrameCallback([&](){ return m_ppu.getFrame(); });
+        m_cpu.setTrace(trace);
+    }
+
+    void EmulatorCore::setCPUProfiler(CPUProfiler* profiler)
+    {
+        m_cpu.setProfiler(profiler);
+        LOG(Info) << "CPU profiling enabled, block translation and idle loop skipping disabled" << std::endl;
+    }
+
+    void EmulatorCore::setWatchpoints(Watchpoints* watchpoints)
+    {
+        if (watchpoints)
+            watchpoints->setHitCallback([&](){ m_cpu.log(); m_stopped = true; });
+        m_watchpoints = watchpoints;
+        m_bus.setWatchpoints(watchpoints);
+        m_pictureBus.setWatchpoints(watchpoints);
+        m_cpu.setWatchpoints(watchpoints);
+        if (watchpoints)
+        {
+            LOG(Info) << "Watchpoints set, block translation, idle loop skipping and run-ahead disabled" << std::endl;
+        }
+    }
+}
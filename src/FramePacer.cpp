@@ -0,0 +1,77 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <thread>
+
+namespace sn
+{
+    //Sleeping may overshoot by the scheduler's granularity, so the end of the wait is spent yielding instead
+    const auto SpinTime = std::chrono::milliseconds(1);
+
+    FramePacer::FramePacer(double frameRate) :
+        m_frameRate(frameRate),
+        m_wakeups(0),
+        m_totalLateness(0),
+        m_maxLateness(0),
+        m_droppedFrames(0)
+    {
+        reset();
+    }
+
+    void FramePacer::reset()
+    {
+        m_start = Clock::now();
+        m_frame = 0;
+    }
+
+    FramePacer::Clock::time_point FramePacer::frameTime(std::uint64_t frame)
+    {
+        return m_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(frame / m_frameRate));
+    }
+
+    int FramePacer::framesDue()
+    {
+        //Frames [0, reached) are due by now
+        std::chrono::duration<double> elapsed = Clock::now() - m_start;
+        std::uint64_t reached = static_cast<std::uint64_t>(elapsed.count() * m_frameRate) + 1;
+        if (reached <= m_frame)
+            return 0;
+
+        std::uint64_t due = reached - m_frame;
+        if (due > MaxCatchUpFrames)
+        {
+            //The schedule moves on without the frames missed, instead of running them all at once
+            m_droppedFrames += due - MaxCatchUpFrames;
+            due = MaxCatchUpFrames;
+        }
+        m_frame = reached;
+        return due;
+    }
+
+    void FramePacer::waitForNextFrame()
+    {
+        auto deadline = frameTime(m_frame);
+        std::this_thread::sleep_until(deadline - SpinTime);
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+
+        auto lateness = Clock::now() - deadline;
+        m_totalLateness += lateness;
+        m_maxLateness = std::max(m_maxLateness, lateness);
+        if (++m_wakeups >= StatsInterval)
+            logStats(InfoVerbose);
+    }
+
+    void FramePacer::logStats(Level level)
+    {
+        using Microseconds = std::chrono::duration<double, std::micro>;
+        if (m_wakeups)
+        {
+            LOG(level) << "Frame pacing: " << m_wakeups << " frames woken up late by "
+                       << Microseconds(m_totalLateness).count() / m_wakeups << "us on average, "
+                       << Microseconds(m_maxLateness).count() << "us at most, "
+                       << m_droppedFrames << " frames dropped" << std::endl;
+        }
+        m_wakeups = m_droppedFrames = 0;
+        m_totalLateness = m_maxLateness = Clock::duration(0);
+    }
+}
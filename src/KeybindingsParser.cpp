@@ -4,6 +4,8 @@
 #include <algorithm>
 #include <cctype>
 
+#include <SFML/Window.hpp>
+
 #include "Controller.h"
 #include "Log.h"
 
@@ -12,25 +12,24 @@ namespace sn
         return instance;
     }
 
-    std::ostream& Log::getCpuTraceStream()
+    Log::Line::~Line()
     {
-        return *m_cpuTrace;
+        Log::get().write(m_buffer.str());
     }
-    std::ostream& Log::getStream()
+
+    void Log::write(const std::string& message)
     {
-        return *m_logStream;
+        std::lock_guard<std::mutex> lock (m_mutex);
+        m_logStream->write(message.data(), message.size());
+        m_logStream->flush();
     }
 
     void Log::setLogStream(std::ostream& stream)
     {
+        std::lock_guard<std::mutex> lock (m_mutex);
         m_logStream = &stream;
     }
 
-    void Log::setCpuTraceStream(std::ostream& stream)
-    {
-        m_cpuTrace = &stream;
-    }
-
     Log& Log::setLevel(Level level)
     {
         m_logLevel = level;
@@ -5,101 +5,164 @@
 namespace sn
 {
     MainBus::MainBus() :
+        m_watchedPages{},
+        m_watchpoints(nullptr),
+        m_cheatPages{},
+        m_cheats(nullptr),
+        m_handlerAccesses(0),
         m_RAM(0x800, 0),
-        m_mapper(nullptr)
+        m_mapper(nullptr),
+        m_readHandlers{},
+        m_writeHandlers{}
     {
+        mapMemory();
     }
 
-    Byte MainBus::read(Address addr)
+    void MainBus::mapMemory()
     {
-        if (addr < 0x2000)
-            return m_RAM[addr & 0x7ff];
-        else if (addr < 0x4020)
-        {
-            if (addr < 0x4000) //PPU registers, mirrored
-            {
-                auto it = m_readCallbacks.find(static_cast<IORegisters>(addr & 0x2007));
-                if (it != m_readCallbacks.end())
-                    return (it -> second)();
-                    //Second object is the pointer to the function object
-                    //Dereference the function pointer and call it
-                else
-                    LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +addr << std::endl;
-            }
-            else if (addr < 0x4018 && addr >= 0x4014) //Only *some* IO registers
-            {
-                auto it = m_readCallbacks.find(static_cast<IORegisters>(addr));
-                if (it != m_readCallbacks.end())
-                    return (it -> second)();
-                    //Second object is the pointer to the function object
-                    //Dereference the function pointer and call it
-                else
-                    LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +addr << std::endl;
-            }
-            else
-                LOG(InfoVerbose) << "Read access attempt at: " << std::hex << +addr << std::endl;
-        }
-        else if (addr < 0x6000)
+        mapPages(0x00, 0x1f, m_RAM.data(), m_RAM.size(), MemoryHandler);
+        mapPages(0x20, 0x3f, nullptr, 0, PPUHandler);
+        mapPages(0x40, 0x40, nullptr, 0, IOHandler);
+        mapPages(0x41, 0x5f, nullptr, 0, ExpansionHandler);
+        if (m_mapper && m_mapper->hasExtendedRAM())
+            mapPages(0x60, 0x7f, m_extRAM.data(), m_extRAM.size(), MemoryHandler);
+        else
+            mapPages(0x60, 0x7f, nullptr, 0, UnmappedHandler);
+        mapPages(0x80, 0xff, nullptr, 0, MapperHandler);
+        if (m_mapper)
+            updatePRGPages();
+    }
+
+    void MainBus::mapPages(int first, int last, Byte* memory, std::size_t mirrorSize, PageHandler handler)
+    {
+        for (int page = first; page <= last; ++page)
         {
-            LOG(InfoVerbose) << "Expansion ROM read attempted. This is currently unsupported" << std::endl;
+            Byte* location = memory ? memory + (((page - first) << 8) % mirrorSize) : nullptr;
+            m_readPages[page] = isReadIntercepted(page) ? nullptr : location;
+            m_writePages[page] = m_watchedPages[page] & WatchWrite ? nullptr : location;
+            m_pageHandlers[page] = handler;
         }
-        else if (addr < 0x8000)
+    }
+
+    void MainBus::updatePRGPages()
+    {
+        //Each page is looked up on its own: offsetting the pointer to the start of its bank instead let
+        //GCC 12 (-O2, induction variable optimization) drop the whole update once inlined into mapMemory
+        for (int page = 0x80; page < 0x100; ++page)
+            m_readPages[page] = isReadIntercepted(page) ? nullptr : m_mapper->getPRGPointer(page << 8);
+    }
+
+    Byte MainBus::peek(Address addr)
+    {
+        const Byte* page = m_readPages[addr >> 8];
+        if (page)
+            return page[addr & 0xff];
+        auto handler = m_pageHandlers[addr >> 8];
+        if (handler == MemoryHandler || handler == MapperHandler)
+            return patch(addr, readPage(addr));
+        return 0;
+    }
+
+    Byte MainBus::readHandler(Address addr)
+    {
+        ++m_handlerAccesses;
+        Byte value = patch(addr, readPage(addr));
+        if (m_watchedPages[addr >> 8] & WatchRead)
+            m_watchpoints->check(CPUAddressSpace, WatchRead, addr, value);
+        return value;
+    }
+
+    void MainBus::writeHandler(Address addr, Byte value)
+    {
+        ++m_handlerAccesses;
+        if (m_watchedPages[addr >> 8] & WatchWrite)
+            m_watchpoints->check(CPUAddressSpace, WatchWrite, addr, value);
+        writePage(addr, value);
+    }
+
+    Byte* MainBus::memoryLocation(Address addr)
+    {
+        return addr < 0x2000 ? &m_RAM[addr & 0x7ff] : &m_extRAM[addr - 0x6000];
+    }
+
+    Byte MainBus::readPage(Address addr)
+    {
+        switch (m_pageHandlers[addr >> 8])
         {
-            if (m_mapper->hasExtendedRAM())
+            case MemoryHandler:
+                return *memoryLocation(addr);
+            case PPUHandler:
             {
-                return m_extRAM[addr - 0x6000];
+                auto& handler = m_readHandlers[registerIndex(addr)];
+                if (handler.read)
+                    return handler.read(handler.object);
+                LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +addr << std::endl;
+                break;
             }
-        }
-        else
-        {
-            return m_mapper->readPRG(addr);
+            case IOHandler:
+                if (addr < 0x4018 && addr >= 0x4014) //Only *some* IO registers
+                {
+                    auto& handler = m_readHandlers[registerIndex(addr)];
+                    if (handler.read)
+                        return handler.read(handler.object);
+                    LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +addr << std::endl;
+                }
+                else if (addr < 0x4020)
+                    LOG(InfoVerbose) << "Read access attempt at: " << std::hex << +addr << std::endl;
+                else
+                    LOG(InfoVerbose) << "Expansion ROM read attempted. This is currently unsupported" << std::endl;
+                break;
+            case ExpansionHandler:
+                LOG(InfoVerbose) << "Expansion ROM read attempted. This is currently unsupported" << std::endl;
+                break;
+            case MapperHandler:
+                return m_mapper->readPRG(addr);
+            default:
+                break;
         }
         return 0;
     }
 
-    void MainBus::write(Address addr, Byte value)
+    void MainBus::writePage(Address addr, Byte value)
     {
-        if (addr < 0x2000)
-            m_RAM[addr & 0x7ff] = value;
-        else if (addr < 0x4020)
+        switch (m_pageHandlers[addr >> 8])
         {
-            if (addr < 0x4000) //PPU registers, mirrored
+            case MemoryHandler:
+                *memoryLocation(addr) = value;
+                break;
+            case PPUHandler:
             {
-                auto it = m_writeCallbacks.find(static_cast<IORegisters>(addr & 0x2007));
-                if (it != m_writeCallbacks.end())
-                    (it -> second)(value);
-                    //Second object is the pointer to the function object
-                    //Dereference the function pointer and call it
+                auto& handler = m_writeHandlers[registerIndex(addr)];
+                if (handler.write)
+                    handler.write(handler.object, value);
                 else
                     LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +addr << std::endl;
+                break;
             }
-            else if (addr < 0x4017 && addr >= 0x4014) //only some registers
-            {
-                auto it = m_writeCallbacks.find(static_cast<IORegisters>(addr));
-                if (it != m_writeCallbacks.end())
-                    (it -> second)(value);
-                    //Second object is the pointer to the function object
-                    //Dereference the function pointer and call it
+            case IOHandler:
+                if (addr < 0x4017 && addr >= 0x4014) //only some registers
+                {
+                    auto& handler = m_writeHandlers[registerIndex(addr)];
+                    if (handler.write)
+                        handler.write(handler.object, value);
+                    else
+                        LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +addr << std::endl;
+                }
+                else if (addr < 0x4020)
+                    LOG(InfoVerbose) << "Write access attmept at: " << std::hex << +addr << std::endl;
                 else
-                    LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +addr << std::endl;
-            }
-            else
-                LOG(InfoVerbose) << "Write access attmept at: " << std::hex << +addr << std::endl;
-        }
-        else if (addr < 0x6000)
-        {
-            LOG(InfoVerbose) << "Expansion ROM access attempted. This is currently unsupported" << std::endl;
-        }
-        else if (addr < 0x8000)
-        {
-            if (m_mapper->hasExtendedRAM())
-            {
-                m_extRAM[addr - 0x6000] = value;
-            }
-        }
-        else
-        {
-            m_mapper->writePRG(addr, value);
+                    LOG(InfoVerbose) << "Expansion ROM access attempted. This is currently unsupported" << std::endl;
+                break;
+            case ExpansionHandler:
+                LOG(InfoVerbose) << "Expansion ROM access attempted. This is currently unsupported" << std::endl;
+                break;
+            case MapperHandler:
+                if (m_mapperWriteCallback)
+                    m_mapperWriteCallback();
+                m_mapper->writePRG(addr, value);
+                break;
+            default:
+                break;
         }
     }
 
@@ -132,6 +195,20 @@ namespace sn
         return nullptr;
     }
 
+    Byte* MainBus::getRAMPtr(Address addr)
+    {
+        if (addr < 0x2000)
+            return &m_RAM[addr & 0x7ff];
+        return nullptr;
+    }
+
+    int MainBus::getPRGBank(Address addr)
+    {
+        if (addr < 0x8000 || !m_mapper)
+            return -1;
+        return m_mapper->getPRGBank(addr);
+    }
+
     bool MainBus::setMapper(Mapper* mapper)
     {
         m_mapper = mapper;
@@ -144,28 +221,75 @@ namespace sn
 
         if (mapper->hasExtendedRAM())
             m_extRAM.resize(0x2000);
+        mapMemory();
 
         return true;
     }
 
-    bool MainBus::setWriteCallback(IORegisters reg, std::function<void(Byte)> callback)
+    void MainBus::setWatchpoints(Watchpoints* watchpoints)
     {
-        if (!callback)
+        m_watchpoints = watchpoints;
+        for (int page = 0; page < 0x100; ++page)
         {
-            LOG(Error) << "callback argument is nullptr" << std::endl;
+            m_watchedPages[page] = watchpoints ?
+                watchpoints->getTypes(CPUAddressSpace, page << 8, (page << 8) | 0xff) & (WatchRead | WatchWrite) : 0;
+        }
+        mapMemory();
+    }
+
+    void MainBus::setCheats(Cheats* cheats)
+    {
+        m_cheats = cheats;
+        for (int page = 0; page < 0x100; ++page)
+            m_cheatPages[page] = cheats && cheats->patches(page << 8, (page << 8) | 0xff);
+        mapMemory();
+    }
+
+    bool MainBus::setWriteHandler(IORegisters reg, WriteHandler handler)
+    {
+        if (!handler.object)
+        {
+            LOG(Error) << "handler object is nullptr" << std::endl;
             return false;
         }
-        return m_writeCallbacks.emplace(reg, callback).second;
+        auto& bound = m_writeHandlers[registerIndex(reg)];
+        if (bound.write)
+            return false;
+        bound = handler;
+        return true;
     }
 
-    bool MainBus::setReadCallback(IORegisters reg, std::function<Byte(void)> callback)
+    bool MainBus::setReadHandler(IORegisters reg, ReadHandler handler)
     {
-        if (!callback)
+        if (!handler.object)
         {
-            LOG(Error) << "callback argument is nullptr" << std::endl;
+            LOG(Error) << "handler object is nullptr" << std::endl;
             return false;
         }
-        return m_readCallbacks.emplace(reg, callback).second;
+        auto& bound = m_readHandlers[registerIndex(reg)];
+        if (bound.read)
+            return false;
+        bound = handler;
+        return true;
+    }
+
+    void MainBus::setMapperWriteCallback(std::function<void(void)> callback)
+    {
+        m_mapperWriteCallback = callback;
+    }
+
+    void MainBus::saveState(Snapshot& snapshot)
+    {
+        snapshot.save(m_RAM);
+        snapshot.save(m_extRAM);
+    }
+
+    void MainBus::loadState(Snapshot& snapshot)
+    {
+        snapshot.load(m_RAM);
+        snapshot.load(m_extRAM);
+        //The sizes are the same, so the pages still point into them. Only the banks may have changed
+        updatePRGPages();
     }
 
 };
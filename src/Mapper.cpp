@@ -11,6 +11,52 @@
 
 namespace sn
 {
+    Mapper::Mapper(Cartridge& cart, Type t) :
+        m_cartridge(cart),
+        m_type(t)
+    {
+        m_prgWindows.fill(nullptr);
+        m_chrWindows.fill(nullptr);
+    }
+
+    void Mapper::mapPRG(Address addr, std::size_t size, std::size_t offset)
+    {
+        const auto& rom = m_cartridge.getROM();
+        for (std::size_t window = 0; window < size / 0x2000; ++window)
+        {
+            m_prgWindows[((addr - 0x8000) >> 13) + window] =
+                    rom.empty() ? nullptr : &rom[(offset + window * 0x2000) % rom.size()];
+        }
+    }
+
+    void Mapper::mapCHRROM(Address addr, std::size_t size, std::size_t offset)
+    {
+        const auto& vrom = m_cartridge.getVROM();
+        for (std::size_t window = 0; window < size / 0x400; ++window)
+        {
+            m_chrWindows[(addr >> 10) + window] =
+                    vrom.empty() ? nullptr : &vrom[(offset + window * 0x400) % vrom.size()];
+        }
+    }
+
+    void Mapper::mapCHR(Address addr, std::size_t size, const Byte* memory)
+    {
+        for (std::size_t window = 0; window < size / 0x400; ++window)
+            m_chrWindows[(addr >> 10) + window] = memory + window * 0x400;
+    }
+
+    void Mapper::saveState(Snapshot& snapshot)
+    {
+        snapshot.save(m_prgWindows);
+        snapshot.save(m_chrWindows);
+    }
+
+    void Mapper::loadState(Snapshot& snapshot)
+    {
+        snapshot.load(m_prgWindows);
+        snapshot.load(m_chrWindows);
+    }
+
     NameTableMirroring Mapper::getNameTableMirroring()
     {
         return static_cast<NameTableMirroring>(m_cartridge.getNameTableMirroring());
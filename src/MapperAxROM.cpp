@@ -16,19 +16,12 @@ namespace sn
         if (cart.getVROM().size() == 0)
         {
             m_characterRAM.resize(0x2000);
+            mapCHR(0x0000, 0x2000, m_characterRAM.data());
             LOG(Info) << "Uses Character RAM OK" << std::endl;
         }
-    }
-
-    Byte MapperAxROM::readPRG(Address address)
-    {
-        if (address >= 0x8000)
-        {
-
-            return m_cartridge.getROM()[m_prgBank * 0x8000 + (address & 0x7FFF)];
-        }
-
-        return 0;
+        else
+            mapCHRROM(0x0000, 0x2000, 0);
+        mapPRG(0x8000, 0x8000, 0);
     }
 
     void MapperAxROM::writePRG(Address address, Byte value)
@@ -36,6 +29,8 @@ namespace sn
         if (address >= 0x8000)
         {
             m_prgBank = value & 0x07;
+            mapPRG(0x8000, 0x8000, m_prgBank * 0x8000);
+            prgBanksChanged();
             m_mirroring = (value & 0x10) ? OneScreenHigher : OneScreenLower;
             m_mirroringCallback();
         }
@@ -46,22 +41,28 @@ namespace sn
         return m_mirroring;
     }
 
-    Byte MapperAxROM::readCHR(Address address)
+    void MapperAxROM::writeCHR(Address address, Byte value)
     {
-        if (address < 0x2000)
+        if (address < m_characterRAM.size())
         {
-            return m_characterRAM[address];
+            m_characterRAM[address] = value;
         }
+    }
 
-        return 0;
+    void MapperAxROM::saveState(Snapshot& snapshot)
+    {
+        Mapper::saveState(snapshot);
+        snapshot.save(m_mirroring);
+        snapshot.save(m_prgBank);
+        snapshot.save(m_characterRAM);
     }
 
-    void MapperAxROM::writeCHR(Address address, Byte value)
+    void MapperAxROM::loadState(Snapshot& snapshot)
     {
-        if (address < 0x2000)
-        {
-            m_characterRAM[address] = value;
-        }
+        Mapper::loadState(snapshot);
+        snapshot.load(m_mirroring);
+        snapshot.load(m_prgBank);
+        snapshot.load(m_characterRAM);
     }
 
 }
@@ -7,36 +7,32 @@ namespace sn
         Mapper(cart, Mapper::CNROM),
         m_selectCHR(0)
     {
-        if (cart.getROM().size() == 0x4000) //1 bank
-        {
-            m_oneBank = true;
-        }
-        else //2 banks
-        {
-            m_oneBank = false;
-        }
+        //A 16KB PRG-ROM wraps around to fill both banks
+        mapPRG(0x8000, 0x8000, 0);
+        mapCHRROM(0x0000, 0x2000, 0);
     }
 
-    Byte MapperCNROM::readPRG(Address addr)
+    void MapperCNROM::writePRG(Address, Byte value)
     {
-        if (!m_oneBank)
-            return m_cartridge.getROM()[addr - 0x8000];
-        else //mirrored
-            return m_cartridge.getROM()[(addr - 0x8000) & 0x3fff];
+        m_selectCHR = value & 0x3;
+        mapCHRROM(0x0000, 0x2000, m_selectCHR << 13);
+        chrBanksChanged();
     }
 
-    void MapperCNROM::writePRG(Address, Byte value)
+    void MapperCNROM::writeCHR(Address addr, Byte)
     {
-        m_selectCHR = value & 0x3;
+        LOG(Info) << "Read-only CHR memory write attempt at " << std::hex << addr << std::endl;
     }
 
-    Byte MapperCNROM::readCHR(Address addr)
+    void MapperCNROM::saveState(Snapshot& snapshot)
     {
-        return m_cartridge.getVROM()[addr | (m_selectCHR << 13)];
+        Mapper::saveState(snapshot);
+        snapshot.save(m_selectCHR);
     }
 
-    void MapperCNROM::writeCHR(Address addr, Byte)
+    void MapperCNROM::loadState(Snapshot& snapshot)
     {
-        LOG(Info) << "Read-only CHR memory write attempt at " << std::hex << addr << std::endl;
+        Mapper::loadState(snapshot);
+        snapshot.load(m_selectCHR);
     }
 }
@@ -7,17 +7,12 @@ namespace sn
     MapperColorDreams::MapperColorDreams(Cartridge &cart,std::function<void(void)> mirroring_cb) :
         Mapper(cart, Mapper::ColorDreams),
         m_mirroring(Vertical),
+        prgbank(0),
+        chrbank(0),
         m_mirroringCallback(mirroring_cb)
-    {}
-
-
-    Byte MapperColorDreams::readPRG(Address address)
     {
-        if (address >= 0x8000)
-        {
-            return  m_cartridge.getROM()[(prgbank * 0x8000) + (address & 0x7fff)];
-        }
-        return 0;
+        mapPRG(0x8000, 0x8000, 0);
+        mapCHRROM(0x0000, 0x2000, 0);
     }
 
 
@@ -26,23 +21,16 @@ namespace sn
         if (address >= 0x8000)
         {
             prgbank = ((value >> 0) & 0x3);
+            mapPRG(0x8000, 0x8000, prgbank * 0x8000);
+            prgBanksChanged();
             chrbank = ((value  >> 4) & 0xF);
+            mapCHRROM(0x0000, 0x2000, chrbank * 0x2000);
+            chrBanksChanged();
 
         }
     }
 
 
-    Byte MapperColorDreams::readCHR(Address address)
-    {
-        if (address <= 0x1FFF)
-        {
-            return   m_cartridge.getVROM()[(chrbank * 0x2000) + address];
-        }
-
-        return 0;
-    }
-
-
     NameTableMirroring MapperColorDreams::getNameTableMirroring()
     {
         return m_mirroring;
@@ -50,4 +38,20 @@ namespace sn
 
 
     void MapperColorDreams::writeCHR(Address, Byte) {}
+
+    void MapperColorDreams::saveState(Snapshot& snapshot)
+    {
+        Mapper::saveState(snapshot);
+        snapshot.save(m_mirroring);
+        snapshot.save(prgbank);
+        snapshot.save(chrbank);
+    }
+
+    void MapperColorDreams::loadState(Snapshot& snapshot)
+    {
+        Mapper::loadState(snapshot);
+        snapshot.load(m_mirroring);
+        snapshot.load(prgbank);
+        snapshot.load(chrbank);
+    }
 }
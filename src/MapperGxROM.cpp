@@ -5,18 +5,13 @@ namespace sn
 
     MapperGxROM::MapperGxROM(Cartridge &cart, std::function<void(void)> mirroring_cb) :
         Mapper(cart, Mapper::GxROM),
+        prgbank(0),
+        chrbank(0),
         m_mirroring(Vertical),
         m_mirroringCallback(mirroring_cb)
-    {}
-
-    Byte MapperGxROM::readPRG(Address address)
     {
-        if (address >= 0x8000)
-        {
-            return m_cartridge.getROM()[(prgbank * 0x8000) + (address & 0x7fff)];
-        }
-
-        return 0;
+        mapPRG(0x8000, 0x8000, 0);
+        mapCHRROM(0x0000, 0x2000, 0);
     }
 
     void MapperGxROM::writePRG(Address address, Byte value)
@@ -24,21 +19,16 @@ namespace sn
         if (address >= 0x8000)
         {
             prgbank = ((value & 0x30) >> 4);
+            mapPRG(0x8000, 0x8000, prgbank * 0x8000);
+            prgBanksChanged();
             chrbank = (value & 0x3);
+            mapCHRROM(0x0000, 0x2000, chrbank * 0x2000);
+            chrBanksChanged();
             m_mirroring = Vertical;
         }
         m_mirroringCallback();
     }
 
-    Byte MapperGxROM::readCHR(Address address)
-    {
-        if (address <= 0x1FFF)
-        {
-            return m_cartridge.getVROM()[chrbank * 0x2000 + address];
-        }
-        return 0;
-    }
-
     NameTableMirroring MapperGxROM::getNameTableMirroring()
     {
         return m_mirroring;
@@ -48,4 +38,20 @@ namespace sn
     {
         LOG(Info) << "not expecting writes here";
     }
+
+    void MapperGxROM::saveState(Snapshot& snapshot)
+    {
+        Mapper::saveState(snapshot);
+        snapshot.save(m_mirroring);
+        snapshot.save(prgbank);
+        snapshot.save(chrbank);
+    }
+
+    void MapperGxROM::loadState(Snapshot& snapshot)
+    {
+        Mapper::loadState(snapshot);
+        snapshot.load(m_mirroring);
+        snapshot.load(prgbank);
+        snapshot.load(chrbank);
+    }
 }
@@ -19,70 +19,17 @@ namespace sn
         m_mirroringCallback(mirroring_cb),
         m_interruptCallback(interrupt_cb)
     {
-        m_prgBank0 = &cart.getROM()[cart.getROM().size() - 0x4000];
-        m_prgBank1 = &cart.getROM()[cart.getROM().size() - 0x2000];
-        m_prgBank2 = &cart.getROM()[cart.getROM().size() - 0x4000];
-        m_prgBank3 = &cart.getROM()[cart.getROM().size() - 0x2000];
+        mapPRG(0x8000, 0x4000, cart.getROM().size() - 0x4000);
+        mapPRG(0xC000, 0x4000, cart.getROM().size() - 0x4000);
 
-
-        for (auto& bank: m_chrBanks)
-        {
-            bank = cart.getVROM().size() - 0x400;
-        }
-        m_chrBanks[0] = cart.getVROM().size() - 0x800;
-        m_chrBanks[3] = cart.getVROM().size() - 0x800;
-    }
-
-
-    Byte MapperMMC3::readPRG(Address addr)
-    {
-        if (addr >= 0x6000 && addr <= 0x7FFF)
-        {
-            return  m_prgRam[addr & 0x1fff];
-        }
-
-
-        if (addr >= 0x8000 && addr <= 0x9FFF)
-        {
-            return *(m_prgBank0 + (addr & 0x1fff));
-        }
-
-        if (addr >= 0xA000 && addr <= 0xBFFF)
-        {
-            return   *(m_prgBank1 + (addr & 0x1fff));
-        }
-
-        if (addr >= 0xC000 && addr <= 0xDFFF)
-        {
-            return *(m_prgBank2 + (addr & 0x1fff));
-        }
-
-        if (addr >= 0xE000)
+        for (Address window = 0; window < 0x2000; window += 0x400)
         {
-            return *(m_prgBank3  +  (addr & 0x1fff));
+            mapCHRROM(window, 0x400, cart.getVROM().size() - 0x400);
         }
-
-        return 0;
-    }
-
-
-    Byte MapperMMC3::readCHR(Address addr)
-    {
-        if (addr < 0x1fff)
-        {
-            // select 1kb bank
-            const auto bankSelect = addr >> 10;
-            // get the configured base address for the bank
-            const auto baseAddress = m_chrBanks[bankSelect];
-            const auto offset = addr & 0x3ff;
-            return m_cartridge.getVROM()[baseAddress + offset];
-        }
-        else if (addr <= 0x2fff)
-        {
-            return m_mirroringRam[addr-0x2000];
-        }
-
-        return 0;
+        mapCHRROM(0x0000, 0x400, cart.getVROM().size() - 0x800);
+        mapCHRROM(0x0C00, 0x400, cart.getVROM().size() - 0x800);
+        // Name tables of the four screen mirroring
+        mapCHR(0x2000, 0x1000, m_mirroringRam.data());
     }
 
 
@@ -110,43 +57,39 @@ namespace sn
                 if (m_chrInversion == 0)
                 {
                     // Add 0xfe mask to ignore lowest bit
-                    m_chrBanks[0] = (m_bankRegister[0] & 0xFE) * 0x0400;
-                    m_chrBanks[1] = (m_bankRegister[0] & 0xFE) * 0x0400 + 0x0400;
-                    m_chrBanks[2] = (m_bankRegister[1] & 0xFE) * 0x0400;
-                    m_chrBanks[3] = (m_bankRegister[1] & 0xFE) * 0x0400 + 0x0400;
-                    m_chrBanks[4] = m_bankRegister[2] * 0x0400;
-                    m_chrBanks[5] = m_bankRegister[3] * 0x0400;
-                    m_chrBanks[6] = m_bankRegister[4] * 0x0400;
-                    m_chrBanks[7] = m_bankRegister[5] * 0x0400;
+                    mapCHRROM(0x0000, 0x0800, (m_bankRegister[0] & 0xFE) * 0x0400);
+                    mapCHRROM(0x0800, 0x0800, (m_bankRegister[1] & 0xFE) * 0x0400);
+                    mapCHRROM(0x1000, 0x0400, m_bankRegister[2] * 0x0400);
+                    mapCHRROM(0x1400, 0x0400, m_bankRegister[3] * 0x0400);
+                    mapCHRROM(0x1800, 0x0400, m_bankRegister[4] * 0x0400);
+                    mapCHRROM(0x1C00, 0x0400, m_bankRegister[5] * 0x0400);
                 }
                 else if (m_chrInversion == 1)
                 {
-                    m_chrBanks[0] = m_bankRegister[2] * 0x0400;
-                    m_chrBanks[1] = m_bankRegister[3] * 0x0400;
-                    m_chrBanks[2] = m_bankRegister[4] * 0x0400;
-                    m_chrBanks[3] = m_bankRegister[5] * 0x0400;
-                    m_chrBanks[4] = (m_bankRegister[0] & 0xFE) * 0x0400;
-                    m_chrBanks[5] = (m_bankRegister[0] & 0xFE) * 0x0400 + 0x0400;
-                    m_chrBanks[6] = (m_bankRegister[1] & 0xFE) * 0x0400;
-                    m_chrBanks[7] = (m_bankRegister[1] & 0xFE) * 0x0400 + 0x0400;
-
+                    mapCHRROM(0x0000, 0x0400, m_bankRegister[2] * 0x0400);
+                    mapCHRROM(0x0400, 0x0400, m_bankRegister[3] * 0x0400);
+                    mapCHRROM(0x0800, 0x0400, m_bankRegister[4] * 0x0400);
+                    mapCHRROM(0x0C00, 0x0400, m_bankRegister[5] * 0x0400);
+                    mapCHRROM(0x1000, 0x0800, (m_bankRegister[0] & 0xFE) * 0x0400);
+                    mapCHRROM(0x1800, 0x0800, (m_bankRegister[1] & 0xFE) * 0x0400);
                 }
+                chrBanksChanged();
 
                 if (m_prgBankMode == 0)
                 {
                     // ignore top two bits for R6 / R7 using 0x3F
-                    m_prgBank0 = &m_cartridge.getROM()[(m_bankRegister[6] & 0x3F) * 0x2000];
-                    m_prgBank1 = &m_cartridge.getROM()[(m_bankRegister[7] & 0x3F) * 0x2000];
-                    m_prgBank2 = &m_cartridge.getROM()[m_cartridge.getROM().size() - 0x4000];
-                    m_prgBank3 = &m_cartridge.getROM()[m_cartridge.getROM().size() - 0x2000];
+                    mapPRG(0x8000, 0x2000, (m_bankRegister[6] & 0x3F) * 0x2000);
+                    mapPRG(0xA000, 0x2000, (m_bankRegister[7] & 0x3F) * 0x2000);
+                    mapPRG(0xC000, 0x4000, m_cartridge.getROM().size() - 0x4000);
                 }
                 else if (m_prgBankMode == 1)
                 {
-                    m_prgBank0 = &m_cartridge.getROM()[m_cartridge.getROM().size() - 0x4000];
-                    m_prgBank1 = &m_cartridge.getROM()[(m_bankRegister[7] & 0x3F) * 0x2000];
-                    m_prgBank2 = &m_cartridge.getROM()[(m_bankRegister[6] & 0x3F) * 0x2000];
-                    m_prgBank3 = &m_cartridge.getROM()[m_cartridge.getROM().size() - 0x2000];
+                    mapPRG(0x8000, 0x2000, m_cartridge.getROM().size() - 0x4000);
+                    mapPRG(0xA000, 0x2000, (m_bankRegister[7] & 0x3F) * 0x2000);
+                    mapPRG(0xC000, 0x2000, (m_bankRegister[6] & 0x3F) * 0x2000);
+                    mapPRG(0xE000, 0x2000, m_cartridge.getROM().size() - 0x2000);
                 }
+                prgBanksChanged();
             }
 
         }
@@ -233,4 +176,36 @@ namespace sn
         return m_mirroring;
     }
 
+    void MapperMMC3::saveState(Snapshot& snapshot)
+    {
+        Mapper::saveState(snapshot);
+        snapshot.save(m_targetRegister);
+        snapshot.save(m_prgBankMode);
+        snapshot.save(m_chrInversion);
+        snapshot.save(m_bankRegister);
+        snapshot.save(m_irqEnabled);
+        snapshot.save(m_irqCounter);
+        snapshot.save(m_irqLatch);
+        snapshot.save(m_irqReloadPending);
+        snapshot.save(m_prgRam);
+        snapshot.save(m_mirroringRam);
+        snapshot.save(m_mirroring);
+    }
+
+    void MapperMMC3::loadState(Snapshot& snapshot)
+    {
+        Mapper::loadState(snapshot);
+        snapshot.load(m_targetRegister);
+        snapshot.load(m_prgBankMode);
+        snapshot.load(m_chrInversion);
+        snapshot.load(m_bankRegister);
+        snapshot.load(m_irqEnabled);
+        snapshot.load(m_irqCounter);
+        snapshot.load(m_irqLatch);
+        snapshot.load(m_irqReloadPending);
+        snapshot.load(m_prgRam);
+        snapshot.load(m_mirroringRam);
+        snapshot.load(m_mirroring);
+    }
+
 } // namespace sn
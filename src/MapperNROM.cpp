@@ -6,31 +6,21 @@ namespace sn
     MapperNROM::MapperNROM(Cartridge &cart) :
         Mapper(cart, Mapper::NROM)
     {
-        if (cart.getROM().size() == 0x4000) //1 bank
-        {
-            m_oneBank = true;
-        }
-        else //2 banks
-        {
-            m_oneBank = false;
-        }
+        //A 16KB PRG-ROM wraps around to fill both banks
+        mapPRG(0x8000, 0x8000, 0);
 
         if (cart.getVROM().size() == 0)
         {
             m_usesCharacterRAM = true;
             m_characterRAM.resize(0x2000);
+            mapCHR(0x0000, 0x2000, m_characterRAM.data());
             LOG(Info) << "Uses character RAM" << std::endl;
         }
         else
+        {
             m_usesCharacterRAM = false;
-    }
-
-    Byte MapperNROM::readPRG(Address addr)
-    {
-        if (!m_oneBank)
-            return m_cartridge.getROM()[addr - 0x8000];
-        else //mirrored
-            return m_cartridge.getROM()[(addr - 0x8000) & 0x3fff];
+            mapCHRROM(0x0000, 0x2000, 0);
+        }
     }
 
     void MapperNROM::writePRG(Address addr, Byte value)
@@ -38,14 +28,6 @@ namespace sn
         LOG(InfoVerbose) << "ROM memory write attempt at " << +addr << " to set " << +value << std::endl;
     }
 
-    Byte MapperNROM::readCHR(Address addr)
-    {
-        if (m_usesCharacterRAM)
-            return m_characterRAM[addr];
-        else
-            return m_cartridge.getVROM()[addr];
-    }
-
     void MapperNROM::writeCHR(Address addr, Byte value)
     {
         if (m_usesCharacterRAM)
@@ -53,4 +35,16 @@ namespace sn
         else
             LOG(Info) << "Read-only CHR memory write attempt at " << std::hex << addr << std::endl;
     }
+
+    void MapperNROM::saveState(Snapshot& snapshot)
+    {
+        Mapper::saveState(snapshot);
+        snapshot.save(m_characterRAM);
+    }
+
+    void MapperNROM::loadState(Snapshot& snapshot)
+    {
+        Mapper::loadState(snapshot);
+        snapshot.load(m_characterRAM);
+    }
 }
@@ -13,36 +13,25 @@ namespace sn
         m_writeCounter(0),
         m_regPRG(0),
         m_regCHR0(0),
-        m_regCHR1(0),
-        m_firstBankPRG(nullptr),
-        m_secondBankPRG(nullptr),
-        m_firstBankCHR(nullptr),
-        m_secondBankCHR(nullptr)
+        m_regCHR1(0)
     {
         if (cart.getVROM().size() == 0)
         {
             m_usesCharacterRAM = true;
             m_characterRAM.resize(0x2000);
+            mapCHR(0x0000, 0x2000, m_characterRAM.data());
             LOG(Info) << "Uses character RAM" << std::endl;
         }
         else
         {
             LOG(Info) << "Using CHR-ROM" << std::endl;
             m_usesCharacterRAM = false;
-            m_firstBankCHR = &cart.getVROM()[0];
-            m_secondBankCHR = &cart.getVROM()[0x1000 * m_regCHR1];
+            mapCHRROM(0x0000, 0x1000, 0);
+            mapCHRROM(0x1000, 0x1000, 0x1000 * m_regCHR1);
         }
 
-        m_firstBankPRG = &cart.getROM()[0]; //first bank
-        m_secondBankPRG = &cart.getROM()[cart.getROM().size() - 0x4000/*0x2000 * 0x0e*/]; //last bank
-    }
-
-    Byte MapperSxROM::readPRG(Address addr)
-    {
-        if (addr < 0xc000)
-            return *(m_firstBankPRG + (addr & 0x3fff));
-        else
-            return *(m_secondBankPRG + (addr & 0x3fff));
+        mapPRG(0x8000, 0x4000, 0); //first bank
+        mapPRG(0xc000, 0x4000, cart.getROM().size() - 0x4000/*0x2000 * 0x0e*/); //last bank
     }
 
     NameTableMirroring MapperSxROM::getNameTableMirroring()
@@ -72,32 +61,28 @@ namespace sn
 
                     m_modeCHR = (m_tempRegister & 0x10) >> 4;
                     m_modePRG = (m_tempRegister & 0xc) >> 2;
-                    calculatePRGPointers();
+                    calculatePRGBanks();
 
-                    //Recalculate CHR pointers
+                    //Recalculate CHR banks
                     if (m_modeCHR == 0) //one 8KB bank
-                    {
-                        m_firstBankCHR = &m_cartridge.getVROM()[0x1000 * (m_regCHR0 | 1)]; //ignore last bit
-                        m_secondBankCHR = m_firstBankCHR + 0x1000;
-                    }
+                        mapCHRBanks(0x0000, 0x2000, 0x1000 * (m_regCHR0 | 1)); //ignore last bit
                     else //two 4KB banks
                     {
-                        m_firstBankCHR = &m_cartridge.getVROM()[0x1000 * m_regCHR0];
-                        m_secondBankCHR = &m_cartridge.getVROM()[0x1000 * m_regCHR1];
+                        mapCHRBanks(0x0000, 0x1000, 0x1000 * m_regCHR0);
+                        mapCHRBanks(0x1000, 0x1000, 0x1000 * m_regCHR1);
                     }
                 }
                 else if (addr <= 0xbfff) //CHR Reg 0
                 {
                     m_regCHR0 = m_tempRegister;
-                    m_firstBankCHR = &m_cartridge.getVROM()[0x1000 * (m_tempRegister | (1 - m_modeCHR))]; //OR 1 if 8KB mode
-                    if (m_modeCHR == 0)
-                        m_secondBankCHR = m_firstBankCHR + 0x1000;
+                    //OR 1 if 8KB mode, which switches both
+                    mapCHRBanks(0x0000, m_modeCHR == 0 ? 0x2000 : 0x1000, 0x1000 * (m_tempRegister | (1 - m_modeCHR)));
                 }
                 else if (addr <= 0xdfff)
                 {
                     m_regCHR1 = m_tempRegister;
                     if(m_modeCHR == 1)
-                        m_secondBankCHR = &m_cartridge.getVROM()[0x1000 * m_tempRegister];
+                        mapCHRBanks(0x1000, 0x1000, 0x1000 * m_tempRegister);
                 }
                 else
                 {
@@ -109,7 +94,7 @@ namespace sn
 
                     m_tempRegister &= 0xf;
                     m_regPRG = m_tempRegister;
-                    calculatePRGPointers();
+                    calculatePRGBanks();
                 }
 
                 m_tempRegister = 0;
@@ -121,38 +106,36 @@ namespace sn
             m_tempRegister = 0;
             m_writeCounter = 0;
             m_modePRG = 3;
-            calculatePRGPointers();
+            calculatePRGBanks();
         }
     }
 
-    void MapperSxROM::calculatePRGPointers()
+    void MapperSxROM::calculatePRGBanks()
     {
         if (m_modePRG <= 1) //32KB changeable
         {
             // equivalent to multiplying 0x8000 * (m_regPRG >> 1)
-            m_firstBankPRG = &m_cartridge.getROM()[0x4000 * (m_regPRG & ~1)];
-            m_secondBankPRG = m_firstBankPRG + 0x4000;   //add 16KB
+            mapPRG(0x8000, 0x8000, 0x4000 * (m_regPRG & ~1));
         }
         else if (m_modePRG == 2) //fix first switch second
         {
-            m_firstBankPRG = &m_cartridge.getROM()[0];
-            m_secondBankPRG = m_firstBankPRG + 0x4000 * m_regPRG;
+            mapPRG(0x8000, 0x4000, 0);
+            mapPRG(0xc000, 0x4000, 0x4000 * m_regPRG);
         }
         else //switch first fix second
         {
-            m_firstBankPRG = &m_cartridge.getROM()[0x4000 * m_regPRG];
-            m_secondBankPRG = &m_cartridge.getROM()[m_cartridge.getROM().size() - 0x4000/*0x2000 * 0x0e*/];
+            mapPRG(0x8000, 0x4000, 0x4000 * m_regPRG);
+            mapPRG(0xc000, 0x4000, m_cartridge.getROM().size() - 0x4000/*0x2000 * 0x0e*/);
         }
+        prgBanksChanged();
     }
 
-    Byte MapperSxROM::readCHR(Address addr)
+    void MapperSxROM::mapCHRBanks(Address addr, std::size_t size, std::size_t offset)
     {
         if (m_usesCharacterRAM)
-            return m_characterRAM[addr];
-        else if (addr < 0x1000)
-            return *(m_firstBankCHR + addr);
-        else
-            return *(m_secondBankCHR + (addr & 0xfff));
+            return;
+        mapCHRROM(addr, size, offset);
+        chrBanksChanged();
     }
 
     void MapperSxROM::writeCHR(Address addr, Byte value)
@@ -162,4 +145,32 @@ namespace sn
         else
             LOG(Info) << "Read-only CHR memory write attempt at " << std::hex << addr << std::endl;
     }
+
+    void MapperSxROM::saveState(Snapshot& snapshot)
+    {
+        Mapper::saveState(snapshot);
+        snapshot.save(m_mirroing);
+        snapshot.save(m_modeCHR);
+        snapshot.save(m_modePRG);
+        snapshot.save(m_tempRegister);
+        snapshot.save(m_writeCounter);
+        snapshot.save(m_regPRG);
+        snapshot.save(m_regCHR0);
+        snapshot.save(m_regCHR1);
+        snapshot.save(m_characterRAM);
+    }
+
+    void MapperSxROM::loadState(Snapshot& snapshot)
+    {
+        Mapper::loadState(snapshot);
+        snapshot.load(m_mirroing);
+        snapshot.load(m_modeCHR);
+        snapshot.load(m_modePRG);
+        snapshot.load(m_tempRegister);
+        snapshot.load(m_writeCounter);
+        snapshot.load(m_regPRG);
+        snapshot.load(m_regCHR0);
+        snapshot.load(m_regCHR1);
+        snapshot.load(m_characterRAM);
+    }
 }
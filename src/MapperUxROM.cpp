@@ -11,33 +11,24 @@ namespace sn
         {
             m_usesCharacterRAM = true;
             m_characterRAM.resize(0x2000);
+            mapCHR(0x0000, 0x2000, m_characterRAM.data());
             LOG(Info) << "Uses character RAM" << std::endl;
         }
         else
+        {
             m_usesCharacterRAM = false;
+            mapCHRROM(0x0000, 0x2000, 0);
+        }
 
-        m_lastBankPtr = &cart.getROM()[cart.getROM().size() - 0x4000]; //last - 16KB
-    }
-
-    Byte MapperUxROM::readPRG(Address addr)
-    {
-        if (addr < 0xc000)
-            return m_cartridge.getROM()[((addr - 0x8000) & 0x3fff) | (m_selectPRG << 14)];
-        else
-            return *(m_lastBankPtr + (addr & 0x3fff));
+        mapPRG(0x8000, 0x4000, 0);
+        mapPRG(0xc000, 0x4000, cart.getROM().size() - 0x4000); //last - 16KB
     }
 
     void MapperUxROM::writePRG(Address, Byte value)
     {
         m_selectPRG = value;
-    }
-
-    Byte MapperUxROM::readCHR(Address addr)
-    {
-        if (m_usesCharacterRAM)
-            return m_characterRAM[addr];
-        else
-            return m_cartridge.getVROM()[addr];
+        mapPRG(0x8000, 0x4000, m_selectPRG << 14);
+        prgBanksChanged();
     }
 
     void MapperUxROM::writeCHR(Address addr, Byte value)
@@ -47,4 +38,18 @@ namespace sn
         else
             LOG(Info) << "Read-only CHR memory write attempt at " << std::hex << addr << std::endl;
     }
+
+    void MapperUxROM::saveState(Snapshot& snapshot)
+    {
+        Mapper::saveState(snapshot);
+        snapshot.save(m_selectPRG);
+        snapshot.save(m_characterRAM);
+    }
+
+    void MapperUxROM::loadState(Snapshot& snapshot)
+    {
+        Mapper::loadState(snapshot);
+        snapshot.load(m_selectPRG);
+        snapshot.load(m_characterRAM);
+    }
 }
@@ -1,23 +1,30 @@
 #include "PPU.h"
 #include "Log.h"
+#include <algorithm>
 
 namespace sn
 {
-    PPU::PPU(PictureBus& bus, VirtualScreen& screen) :
+    PPU::PPU(PictureBus& bus) :
         m_bus(bus),
-        m_screen(screen),
         m_spriteMemory(64 * 4),
-        m_pictureBuffer(ScanlineVisibleDots, std::vector<sf::Color>(VisibleScanlines, sf::Color::Magenta))
-    {}
+        m_pictureBuffer(ScanlineVisibleDots * VisibleScanlines, sf::Color::Magenta),
+        m_framebuffer(ScanlineVisibleDots * VisibleScanlines, sf::Color::White),
+        m_renderSkip(false)
+    {
+        reset();
+    }
 
     void PPU::reset()
     {
-        m_longSprites = m_generateInterrupt = m_greyscaleMode = m_vblank = m_spriteOverflow = false;
+        m_longSprites = m_generateInterrupt = m_greyscaleMode = m_vblank = m_sprZeroHit = m_spriteOverflow = false;
+        m_hideEdgeSprites = m_hideEdgeBackground = false;
+        m_lastStatus = m_dataBuffer = 0;
         m_showBackground = m_showSprites = m_evenFrame = m_firstWrite = true;
         m_bgPage = m_sprPage = Low;
         m_dataAddress = m_cycle = m_scanline = m_spriteDataAddress = m_fineXScroll = m_tempAddress = 0;
         //m_baseNameTable = 0x2000;
         m_dataAddrIncrement = 1;
+        m_frame = 0;
         m_pipelineState = PreRender;
         m_scanlineSprites.reserve(8);
         m_scanlineSprites.resize(0);
@@ -28,6 +35,11 @@ namespace sn
         m_vblankCallback = cb;
     }
 
+    void PPU::setFrameCallback(std::function<void(void)> cb)
+    {
+        m_frameCallback = cb;
+    }
+
     void PPU::step()
     {
         switch (m_pipelineState)
@@ -64,127 +76,11 @@ namespace sn
             case Render:
                 if (m_cycle > 0 && m_cycle <= ScanlineVisibleDots)
                 {
-                    Byte bgColor = 0, sprColor = 0;
-                    bool bgOpaque = false, sprOpaque = true;
-                    bool spriteForeground = false;
-
-                    int x = m_cycle - 1;
-                    int y = m_scanline;
-
-                    if (m_showBackground)
-                    {
-                        auto x_fine = (m_fineXScroll + x) % 8;
-                        if (!m_hideEdgeBackground || x >= 8)
-                        {
-                            //fetch tile
-                            auto addr = 0x2000 | (m_dataAddress & 0x0FFF); //mask off fine y
-                            //auto addr = 0x2000 + x / 8 + (y / 8) * (ScanlineVisibleDots / 8);
-                            Byte tile = read(addr);
-
-                            //fetch pattern
-                            //Each pattern occupies 16 bytes, so multiply by 16
-                            addr = (tile * 16) + ((m_dataAddress >> 12/*y % 8*/) & 0x7); //Add fine y
-                            addr |= m_bgPage << 12; //set whether the pattern is in the high or low page
-                            //Get the corresponding bit determined by (8 - x_fine) from the right
-                            bgColor = (read(addr) >> (7 ^ x_fine)) & 1; //bit 0 of palette entry
-                            bgColor |= ((read(addr + 8) >> (7 ^ x_fine)) & 1) << 1; //bit 1
-
-                            bgOpaque = bgColor; //flag used to calculate final pixel with the sprite pixel
-
-                            //fetch attribute and calculate higher two bits of palette
-                            addr = 0x23C0 | (m_dataAddress & 0x0C00) | ((m_dataAddress >> 4) & 0x38)
-                                        | ((m_dataAddress >> 2) & 0x07);
-                            auto attribute = read(addr);
-                            int shift = ((m_dataAddress >> 4) & 4) | (m_dataAddress & 2);
-                            //Extract and set the upper two bits for the color
-                            bgColor |= ((attribute >> shift) & 0x3) << 2;
-                        }
-                        //Increment/wrap coarse X
-                        if (x_fine == 7)
-                        {
-                            if ((m_dataAddress & 0x001F) == 31) // if coarse X == 31
-                            {
-                                m_dataAddress &= ~0x001F;          // coarse X = 0
-                                m_dataAddress ^= 0x0400;           // switch horizontal nametable
-                            }
-                            else
-                            {
-                                m_dataAddress += 1;                // increment coarse X
-                            }
-                        }
-                    }
-
-                    if (m_showSprites && (!m_hideEdgeSprites || x >= 8))
-                    {
-                        for (auto i : m_scanlineSprites)
-                        {
-                            Byte spr_x =     m_spriteMemory[i * 4 + 3];
-
-                            if (0 > x - spr_x || x - spr_x >= 8)
-                                continue;
-
-                            Byte spr_y     = m_spriteMemory[i * 4 + 0] + 1,
-                                 tile      = m_spriteMemory[i * 4 + 1],
-                                 attribute = m_spriteMemory[i * 4 + 2];
-
-                            int length = (m_longSprites) ? 16 : 8;
-
-                            int x_shift = (x - spr_x) % 8, y_offset = (y - spr_y) % length;
-
-                            if ((attribute & 0x40) == 0) //If NOT flipping horizontally
-                                x_shift ^= 7;
-                            if ((attribute & 0x80) != 0) //IF flipping vertically
-                                y_offset ^= (length - 1);
-
-                            Address addr = 0;
-
-                            if (!m_longSprites)
-                            {
-                                addr = tile * 16 + y_offset;
-                                if (m_sprPage == High) addr += 0x1000;
-                            }
-                            else //8x16 sprites
-                            {
-                                //bit-3 is one if it is the bottom tile of the sprite, multiply by two to get the next pattern
-                                y_offset = (y_offset & 7) | ((y_offset & 8) << 1);
-                                addr = (tile >> 1) * 32 + y_offset;
-                                addr |= (tile & 1) << 12; //Bank 0x1000 if bit-0 is high
-                            }
-
-                            sprColor |= (read(addr) >> (x_shift)) & 1; //bit 0 of palette entry
-                            sprColor |= ((read(addr + 8) >> (x_shift)) & 1) << 1; //bit 1
-
-                            if (!(sprOpaque = sprColor))
-                            {
-                                sprColor = 0;
-                                continue;
-                            }
-
-                            sprColor |= 0x10; //Select sprite palette
-                            sprColor |= (attribute & 0x3) << 2; //bits 2-3
-
-                            spriteForeground = !(attribute & 0x20);
-
-                            //Sprite-0 hit detection
-                            if (!m_sprZeroHit && m_showBackground && i == 0 && sprOpaque && bgOpaque)
-                            {
-                                m_sprZeroHit = true;
-                            }
-
-                            break; //Exit the loop now since we've found the highest priority sprite
-                        }
-                    }
-
-                    Byte paletteAddr = bgColor;
-
-                    if ( (!bgOpaque && sprOpaque) ||
-                         (bgOpaque && sprOpaque && spriteForeground) )
-                        paletteAddr = sprColor;
-                    else if (!bgOpaque && !sprOpaque)
-                        paletteAddr = 0;
-                    //else bgColor
-
-                    m_pictureBuffer[x][y] = sf::Color(colors[m_bus.readPalette(paletteAddr)]);
+                    //A frame that isn't shown only needs the dots the CPU can tell apart, where sprite 0 may hit
+                    if (!m_renderSkip || maySetSpriteZeroHit(m_cycle - 1))
+                        renderDot(m_cycle - 1);
+                    else if (m_showBackground && (m_fineXScroll + m_cycle - 1) % 8 == 7)
+                        incrementCoarseX();
                 }
                 else if (m_cycle == ScanlineVisibleDots + 1 && m_showBackground)
                 {
@@ -268,14 +164,10 @@ namespace sn
                     m_cycle = 0;
                     m_pipelineState = VerticalBlank;
 
-                    for (std::size_t x = 0; x < m_pictureBuffer.size(); ++x)
-                    {
-                        for (std::size_t y = 0; y < m_pictureBuffer[0].size(); ++y)
-                        {
-                            m_screen.setPixel(x, y, m_pictureBuffer[x][y]);
-                        }
-                    }
-
+                    //Every dot of the picture is drawn again in the next frame
+                    m_framebuffer.swap(m_pictureBuffer);
+                    if (m_frameCallback)
+                        m_frameCallback();
                 }
 
                 break;
@@ -297,6 +189,7 @@ namespace sn
                     m_pipelineState = PreRender;
                     m_scanline = 0;
                     m_evenFrame = !m_evenFrame;
+                    ++m_frame;
                 }
 
                 break;
@@ -307,6 +200,208 @@ namespace sn
         ++m_cycle;
     }
 
+    void PPU::renderDot(int x)
+    {
+        Byte bgColor = 0, sprColor = 0;
+        bool bgOpaque = false, sprOpaque = true;
+        bool spriteForeground = false;
+
+        int y = m_scanline;
+
+        if (m_showBackground)
+        {
+            auto x_fine = (m_fineXScroll + x) % 8;
+            if (!m_hideEdgeBackground || x >= 8)
+            {
+                //fetch tile
+                auto addr = 0x2000 | (m_dataAddress & 0x0FFF); //mask off fine y
+                //auto addr = 0x2000 + x / 8 + (y / 8) * (ScanlineVisibleDots / 8);
+                Byte tile = read(addr);
+
+                //fetch pattern
+                //Each pattern occupies 16 bytes, so multiply by 16
+                addr = (tile * 16) + ((m_dataAddress >> 12/*y % 8*/) & 0x7); //Add fine y
+                addr |= m_bgPage << 12; //set whether the pattern is in the high or low page
+                //Get the corresponding bit determined by (8 - x_fine) from the right
+                bgColor = (read(addr) >> (7 ^ x_fine)) & 1; //bit 0 of palette entry
+                bgColor |= ((read(addr + 8) >> (7 ^ x_fine)) & 1) << 1; //bit 1
+
+                bgOpaque = bgColor; //flag used to calculate final pixel with the sprite pixel
+
+                //fetch attribute and calculate higher two bits of palette
+                addr = 0x23C0 | (m_dataAddress & 0x0C00) | ((m_dataAddress >> 4) & 0x38)
+                            | ((m_dataAddress >> 2) & 0x07);
+                auto attribute = read(addr);
+                int shift = ((m_dataAddress >> 4) & 4) | (m_dataAddress & 2);
+                //Extract and set the upper two bits for the color
+                bgColor |= ((attribute >> shift) & 0x3) << 2;
+            }
+            //Increment/wrap coarse X
+            if (x_fine == 7)
+                incrementCoarseX();
+        }
+
+        if (m_showSprites && (!m_hideEdgeSprites || x >= 8))
+        {
+            for (auto i : m_scanlineSprites)
+            {
+                Byte spr_x =     m_spriteMemory[i * 4 + 3];
+
+                if (0 > x - spr_x || x - spr_x >= 8)
+                    continue;
+
+                Byte spr_y     = m_spriteMemory[i * 4 + 0] + 1,
+                     tile      = m_spriteMemory[i * 4 + 1],
+                     attribute = m_spriteMemory[i * 4 + 2];
+
+                int length = (m_longSprites) ? 16 : 8;
+
+                int x_shift = (x - spr_x) % 8, y_offset = (y - spr_y) % length;
+
+                if ((attribute & 0x40) == 0) //If NOT flipping horizontally
+                    x_shift ^= 7;
+                if ((attribute & 0x80) != 0) //IF flipping vertically
+                    y_offset ^= (length - 1);
+
+                Address addr = 0;
+
+                if (!m_longSprites)
+                {
+                    addr = tile * 16 + y_offset;
+                    if (m_sprPage == High) addr += 0x1000;
+                }
+                else //8x16 sprites
+                {
+                    //bit-3 is one if it is the bottom tile of the sprite, multiply by two to get the next pattern
+                    y_offset = (y_offset & 7) | ((y_offset & 8) << 1);
+                    addr = (tile >> 1) * 32 + y_offset;
+                    addr |= (tile & 1) << 12; //Bank 0x1000 if bit-0 is high
+                }
+
+                sprColor |= (read(addr) >> (x_shift)) & 1; //bit 0 of palette entry
+                sprColor |= ((read(addr + 8) >> (x_shift)) & 1) << 1; //bit 1
+
+                if (!(sprOpaque = sprColor))
+                {
+                    sprColor = 0;
+                    continue;
+                }
+
+                sprColor |= 0x10; //Select sprite palette
+                sprColor |= (attribute & 0x3) << 2; //bits 2-3
+
+                spriteForeground = !(attribute & 0x20);
+
+                //Sprite-0 hit detection
+                if (!m_sprZeroHit && m_showBackground && i == 0 && sprOpaque && bgOpaque)
+                {
+                    m_sprZeroHit = true;
+                }
+
+                break; //Exit the loop now since we've found the highest priority sprite
+            }
+        }
+
+        Byte paletteAddr = bgColor;
+
+        if ( (!bgOpaque && sprOpaque) ||
+             (bgOpaque && sprOpaque && spriteForeground) )
+            paletteAddr = sprColor;
+        else if (!bgOpaque && !sprOpaque)
+            paletteAddr = 0;
+        //else bgColor
+
+        if (!m_renderSkip)
+            m_pictureBuffer[y * ScanlineVisibleDots + x] = sf::Color(colors[m_bus.readPalette(paletteAddr)]);
+    }
+
+    void PPU::incrementCoarseX()
+    {
+        if ((m_dataAddress & 0x001F) == 31) // if coarse X == 31
+        {
+            m_dataAddress &= ~0x001F;          // coarse X = 0
+            m_dataAddress ^= 0x0400;           // switch horizontal nametable
+        }
+        else
+        {
+            m_dataAddress += 1;                // increment coarse X
+        }
+    }
+
+    bool PPU::maySetSpriteZeroHit(int x)
+    {
+        if (m_sprZeroHit || !m_showBackground || !m_showSprites ||
+            m_scanlineSprites.empty() || m_scanlineSprites[0] != 0)
+            return false;
+        int offset = x - m_spriteMemory[3];
+        return 0 <= offset && offset < 8;
+    }
+
+    void PPU::run(int dots)
+    {
+        for (int i = 0; i < dots; ++i)
+            step();
+    }
+
+    int PPU::getEventHorizon()
+    {
+        //Dots left before the dot with the given cycle is processed
+        int horizon = ScanlineCycleLength;
+        auto until = [&](int cycle)
+        {
+            if (m_cycle <= cycle)
+                horizon = std::min(horizon, cycle - m_cycle);
+        };
+
+        bool rendering = m_showBackground && m_showSprites;
+        switch (m_pipelineState)
+        {
+            case PreRender:
+                until(1); //flags cleared
+                if (rendering)
+                    until(260); //mapper scanline counter
+                until(ScanlineEndCycle - 1); //shorter odd frames
+                break;
+            case Render:
+                if (rendering)
+                    until(260);
+                //Sprite-0 hit, from the first dot of sprite 0 on this scanline
+                if (rendering && !m_sprZeroHit && !m_scanlineSprites.empty() && m_scanlineSprites[0] == 0)
+                {
+                    int spriteStart = m_spriteMemory[3] + 1;
+                    if (m_cycle <= spriteStart + 7)
+                        horizon = std::min(horizon, std::max(spriteStart - m_cycle, 0));
+                }
+                until(ScanlineEndCycle); //sprite evaluation for the next scanline, overflow
+                break;
+            case PostRender:
+                until(ScanlineEndCycle);
+                break;
+            case VerticalBlank:
+                if (m_scanline == VisibleScanlines + 1)
+                    until(1); //vertical blank and NMI
+                until(ScanlineEndCycle);
+                break;
+        }
+        return std::max(horizon, 0);
+    }
+
+    int PPU::getInterruptHorizon()
+    {
+        //Close to the vertical blank, or with a scanline counter that may interrupt, every event counts
+        if ((m_pipelineState != Render && m_pipelineState != PostRender) ||
+            (m_showBackground && m_showSprites && m_bus.hasScanlineIRQ()))
+            return getEventHorizon();
+
+        //Scanlines take at least ScanlineEndCycle dots, the NMI comes on the first dot of the vertical blank
+        return std::max((VisibleScanlines - m_scanline + 1) * ScanlineEndCycle - m_cycle, 0);
+    }
+
+    bool PPU::isStatusUnchanged()
+    {
+        return statusFlags() == m_lastStatus;
+    }
+
     Byte PPU::readOAM(Byte addr)
     {
         return m_spriteMemory[addr];
@@ -350,11 +445,17 @@ namespace sn
         m_showSprites = mask & 0x10;
     }
 
+    Byte PPU::statusFlags()
+    {
+        return m_spriteOverflow << 5 |
+               m_sprZeroHit << 6 |
+               m_vblank << 7;
+    }
+
     Byte PPU::getStatus()
     {
-        Byte status = m_spriteOverflow << 5 |
-                      m_sprZeroHit << 6 |
-                      m_vblank << 7;
+        Byte status = statusFlags();
+        m_lastStatus = status;
         //m_dataAddress = 0;
 
         // Reading status clears vblank!
@@ -383,7 +484,7 @@ namespace sn
 
     Byte PPU::getData()
     {
-        auto data = m_bus.read(m_dataAddress);
+        auto data = m_bus.readData(m_dataAddress);
         m_dataAddress += m_dataAddrIncrement;
 
         //Reads are delayed by one byte/read when address is in this range
@@ -403,7 +504,7 @@ namespace sn
 
     void PPU::setData(Byte data)
     {
-        m_bus.write(m_dataAddress, data);
+        m_bus.writeData(m_dataAddress, data);
         m_dataAddress += m_dataAddrIncrement;
     }
 
@@ -440,4 +541,68 @@ namespace sn
         return m_bus.read(addr);
     }
 
+    void PPU::saveState(Snapshot& snapshot)
+    {
+        snapshot.save(m_spriteMemory);
+        snapshot.save(m_scanlineSprites);
+        snapshot.save(m_pipelineState);
+        snapshot.save(m_cycle);
+        snapshot.save(m_scanline);
+        snapshot.save(m_evenFrame);
+        snapshot.save(m_frame);
+        snapshot.save(m_vblank);
+        snapshot.save(m_sprZeroHit);
+        snapshot.save(m_spriteOverflow);
+        snapshot.save(m_lastStatus);
+        snapshot.save(m_dataAddress);
+        snapshot.save(m_tempAddress);
+        snapshot.save(m_fineXScroll);
+        snapshot.save(m_firstWrite);
+        snapshot.save(m_dataBuffer);
+        snapshot.save(m_spriteDataAddress);
+        snapshot.save(m_longSprites);
+        snapshot.save(m_generateInterrupt);
+        snapshot.save(m_greyscaleMode);
+        snapshot.save(m_showSprites);
+        snapshot.save(m_showBackground);
+        snapshot.save(m_hideEdgeSprites);
+        snapshot.save(m_hideEdgeBackground);
+        snapshot.save(m_bgPage);
+        snapshot.save(m_sprPage);
+        snapshot.save(m_dataAddrIncrement);
+        snapshot.save(m_pictureBuffer);
+    }
+
+    void PPU::loadState(Snapshot& snapshot)
+    {
+        snapshot.load(m_spriteMemory);
+        snapshot.load(m_scanlineSprites);
+        snapshot.load(m_pipelineState);
+        snapshot.load(m_cycle);
+        snapshot.load(m_scanline);
+        snapshot.load(m_evenFrame);
+        snapshot.load(m_frame);
+        snapshot.load(m_vblank);
+        snapshot.load(m_sprZeroHit);
+        snapshot.load(m_spriteOverflow);
+        snapshot.load(m_lastStatus);
+        snapshot.load(m_dataAddress);
+        snapshot.load(m_tempAddress);
+        snapshot.load(m_fineXScroll);
+        snapshot.load(m_firstWrite);
+        snapshot.load(m_dataBuffer);
+        snapshot.load(m_spriteDataAddress);
+        snapshot.load(m_longSprites);
+        snapshot.load(m_generateInterrupt);
+        snapshot.load(m_greyscaleMode);
+        snapshot.load(m_showSprites);
+        snapshot.load(m_showBackground);
+        snapshot.load(m_hideEdgeSprites);
+        snapshot.load(m_hideEdgeBackground);
+        snapshot.load(m_bgPage);
+        snapshot.load(m_sprPage);
+        snapshot.load(m_dataAddrIncrement);
+        snapshot.load(m_pictureBuffer);
+    }
+
 }
@@ -7,10 +7,15 @@ namespace sn
     PictureBus::PictureBus() :
         m_palette(0x20),
         m_RAM(0x800),
-        m_mapper(nullptr)
-    {}
+        m_mapper(nullptr),
+        m_hasScanlineIRQ(false),
+        m_watchedPages{},
+        m_watchpoints(nullptr)
+    {
+        m_readPages.fill(nullptr);
+    }
 
-    Byte PictureBus::read(Address addr)
+    Byte PictureBus::readHandler(Address addr)
     {
         if (addr < 0x2000)
         {
@@ -92,6 +97,31 @@ namespace sn
        }
     }
 
+    Byte PictureBus::readData(Address addr)
+    {
+        Byte value = read(addr);
+        if (m_watchedPages[(addr >> 10) & 0xf] & WatchRead)
+            m_watchpoints->check(PPUAddressSpace, WatchRead, addr & 0x3fff, value);
+        return value;
+    }
+
+    void PictureBus::writeData(Address addr, Byte value)
+    {
+        if (m_watchedPages[(addr >> 10) & 0xf] & WatchWrite)
+            m_watchpoints->check(PPUAddressSpace, WatchWrite, addr & 0x3fff, value);
+        write(addr, value);
+    }
+
+    void PictureBus::setWatchpoints(Watchpoints* watchpoints)
+    {
+        m_watchpoints = watchpoints;
+        for (int page = 0; page < 0x10; ++page)
+        {
+            m_watchedPages[page] = watchpoints ?
+                watchpoints->getTypes(PPUAddressSpace, page << 10, (page << 10) | 0x3ff) & (WatchRead | WatchWrite) : 0;
+        }
+    }
+
     void PictureBus::updateMirroring()
     {
         switch (m_mapper->getNameTableMirroring())
@@ -122,6 +152,30 @@ namespace sn
                 NameTable0 = NameTable1 = NameTable2 = NameTable3 = 0;
                 LOG(Error) << "Unsupported Name Table mirroring : " << m_mapper->getNameTableMirroring() << std::endl;
         }
+        updateNameTablePages();
+    }
+
+    void PictureBus::updateCHRPages()
+    {
+        for (int page = 0; page < 8; ++page)
+            m_readPages[page] = m_mapper->getCHRPointer(page << 10);
+    }
+
+    void PictureBus::updateNameTablePages()
+    {
+        //0x3c00 and above is left to readHandler for the palette
+        for (int page = 8; page < 0xf; ++page)
+        {
+            //Name tables upto 0x3000, then mirrored
+            Address addr = 0x2000 | ((page & 0x3) << 10);
+            if (NameTable0 >= m_RAM.size())
+                m_readPages[page] = m_mapper->getCHRPointer(addr);
+            else
+            {
+                const std::size_t nameTables[] = {NameTable0, NameTable1, NameTable2, NameTable3};
+                m_readPages[page] = &m_RAM[nameTables[page & 0x3]];
+            }
+        }
     }
 
     bool PictureBus::setMapper(Mapper *mapper)
@@ -133,11 +187,32 @@ namespace sn
         }
 
         m_mapper = mapper;
+        m_hasScanlineIRQ = mapper->hasScanlineIRQ();
         updateMirroring();
+        updateCHRPages();
         return true;
     }
 
-    void PictureBus::scanlineIRQ(){
-        m_mapper->scanlineIRQ();
+    void PictureBus::saveState(Snapshot& snapshot)
+    {
+        snapshot.save(NameTable0);
+        snapshot.save(NameTable1);
+        snapshot.save(NameTable2);
+        snapshot.save(NameTable3);
+        snapshot.save(m_palette);
+        snapshot.save(m_RAM);
+    }
+
+    void PictureBus::loadState(Snapshot& snapshot)
+    {
+        snapshot.load(NameTable0);
+        snapshot.load(NameTable1);
+        snapshot.load(NameTable2);
+        snapshot.load(NameTable3);
+        snapshot.load(m_palette);
+        snapshot.load(m_RAM);
+        //The mapper is loaded first
+        updateCHRPages();
+        updateNameTablePages();
     }
 }
@@ -0,0 +1,29 @@
+#include "Scheduler.h"
+#include <algorithm>
+#include <limits>
+
+namespace sn
+{
+    Scheduler::Scheduler() :
+        m_time(0)
+    {
+    }
+
+    void Scheduler::reset()
+    {
+        m_time = 0;
+    }
+
+    void Scheduler::addComponent(std::function<int(void)> nextEvent)
+    {
+        m_components.push_back(nextEvent);
+    }
+
+    int Scheduler::getEventHorizon()
+    {
+        int horizon = std::numeric_limits<int>::max();
+        for (auto& nextEvent : m_components)
+            horizon = std::min(horizon, nextEvent());
+        return horizon;
+    }
+}
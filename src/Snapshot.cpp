@@ -0,0 +1,35 @@
+#include "Snapshot.h"
+#include "Log.h"
+
+#include <cstring>
+
+namespace sn
+{
+    Snapshot::Snapshot() :
+        m_position(0)
+    {
+    }
+
+    void Snapshot::clear()
+    {
+        m_data.clear();
+        m_position = 0;
+    }
+
+    void Snapshot::saveBytes(const void* data, std::size_t size)
+    {
+        auto bytes = static_cast<const std::uint8_t*>(data);
+        m_data.insert(m_data.end(), bytes, bytes + size);
+    }
+
+    void Snapshot::loadBytes(void* data, std::size_t size)
+    {
+        if (m_position + size > m_data.size())
+        {
+            LOG(Error) << "Loading past the end of the snapshot" << std::endl;
+            return;
+        }
+        std::memcpy(data, &m_data[m_position], size);
+        m_position += size;
+    }
+}
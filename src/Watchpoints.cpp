@@ -0,0 +1,70 @@
+#include "Watchpoints.h"
+#include "Log.h"
+#include <sstream>
+
+namespace sn
+{
+    void Watchpoints::add(AddressSpace space, int types, Address first, Address last)
+    {
+        m_watches.push_back({space, types, first, last});
+    }
+
+    bool Watchpoints::add(AddressSpace space, int types, const std::string& range)
+    {
+        unsigned int first, last;
+        char separator = '-';
+        std::stringstream ss (range);
+        if (!(ss >> std::hex >> first))
+            return false;
+        if (!(ss >> separator >> last))
+            last = first;
+
+        const unsigned int end = space == PPUAddressSpace ? 0x3fff : 0xffff;
+        if (separator != '-' || first > last || last > end || !ss.eof())
+            return false;
+        add(space, types, first, last);
+        return true;
+    }
+
+    int Watchpoints::getTypes(AddressSpace space, Address first, Address last)
+    {
+        int types = 0;
+        for (const auto& watch : m_watches)
+        {
+            if (watch.space == space && watch.first <= last && watch.last >= first)
+                types |= watch.types;
+        }
+        return types;
+    }
+
+    bool Watchpoints::check(AddressSpace space, WatchType type, Address addr, Byte value)
+    {
+        if (!(getTypes(space, addr, addr) & type))
+            return false;
+
+        const char* bus = space == PPUAddressSpace ? "PPU" : "CPU";
+        if (type == WatchExecute)
+        {
+            LOG(Info) << "Breakpoint hit: execution at 0x" << std::hex << +addr << std::dec << std::endl;
+        }
+        else if (type == WatchRead)
+        {
+            LOG(Info) << "Watchpoint hit: " << bus << " read of 0x" << std::hex << +value
+                      << " from 0x" << +addr << std::dec << std::endl;
+        }
+        else
+        {
+            LOG(Info) << "Watchpoint hit: " << bus << " write of 0x" << std::hex << +value
+                      << " to 0x" << +addr << std::dec << std::endl;
+        }
+
+        if (m_hitCallback)
+            m_hitCallback();
+        return true;
+    }
+
+    void Watchpoints::setHitCallback(std::function<void(void)> callback)
+    {
+        m_hitCallback = callback;
+    }
+}
@@ -0,0 +1,557 @@
+#!/usr/bin/env python3
+"""Benchmark and regression check driver for SimpleNES.
+
+The workloads are small NES programs assembled here, so that the numbers can be
+reproduced without any game ROM. Each is written to a .nes file and run headless.
+
+    benchmark.py SimpleNES [SimpleNES-other ...]
+        Runs every workload with --benchmark on each binary, interleaved, and prints
+        the best frames/s of each.
+    benchmark.py --check SimpleNES
+        Runs every workload with --verify-accuracy, which compares the default CPU
+        against the cycle accurate one with the PPU stepped on every cycle, pictures
+        included. Compares the hash of the last picture and of the decoded --log-cpu
+        trace with the ones recorded below. Exits with 1 on any difference.
+    benchmark.py --write DIR
+        Only writes the workload ROMs to DIR.
+"""
+
+import argparse
+import hashlib
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+# Opcodes of the official instructions by mnemonic and addressing mode
+IMPLIED = {
+    'BRK': 0x00, 'PHP': 0x08, 'CLC': 0x18, 'PLP': 0x28, 'SEC': 0x38, 'RTI': 0x40, 'PHA': 0x48,
+    'CLI': 0x58, 'RTS': 0x60, 'PLA': 0x68, 'SEI': 0x78, 'DEY': 0x88, 'TXA': 0x8a, 'TYA': 0x98,
+    'TXS': 0x9a, 'TAY': 0xa8, 'TAX': 0xaa, 'CLV': 0xb8, 'TSX': 0xba, 'INY': 0xc8, 'DEX': 0xca,
+    'CLD': 0xd8, 'INX': 0xe8, 'NOP': 0xea, 'SED': 0xf8,
+}
+BRANCHES = {'BPL': 0x10, 'BMI': 0x30, 'BVC': 0x50, 'BVS': 0x70, 'BCC': 0x90, 'BCS': 0xb0, 'BNE': 0xd0, 'BEQ': 0xf0}
+# Opcode of the mnemonic in its zero page mode and the offsets of the other modes from it
+GROUP1 = {'ORA': 0x05, 'AND': 0x25, 'EOR': 0x45, 'ADC': 0x65, 'STA': 0x85, 'LDA': 0xa5, 'CMP': 0xc5, 'SBC': 0xe5}
+GROUP1_MODES = {'izx': -4, 'zp': 0, 'imm': 4, 'abs': 8, 'izy': 12, 'zpx': 16, 'aby': 20, 'abx': 24}
+GROUP2 = {'ASL': 0x06, 'ROL': 0x26, 'LSR': 0x46, 'ROR': 0x66, 'STX': 0x86, 'LDX': 0xa6, 'DEC': 0xc6, 'INC': 0xe6,
+          'BIT': 0x24, 'STY': 0x84, 'LDY': 0xa4, 'CPY': 0xc4, 'CPX': 0xe4}
+GROUP2_MODES = {'imm': -4, 'zp': 0, 'acc': 4, 'abs': 8, 'zpx': 16, 'zpy': 16, 'abx': 24, 'aby': 24}
+
+
+class Assembler:
+    """Two pass assembler for the official instructions, one per line, with labels ending in ':'."""
+
+    def __init__(self, origin):
+        self.origin = origin
+
+    def assemble(self, source):
+        labels = {}
+        for final in (False, True):
+            code = bytearray()
+            for line in source.splitlines():
+                line = line.split(';')[0].strip()
+                if not line:
+                    continue
+                if line.endswith(':'):
+                    labels[line[:-1]] = self.origin + len(code)
+                    continue
+                code += self.instruction(line, labels, final, self.origin + len(code))
+        return bytes(code), labels
+
+    def instruction(self, line, labels, final, pc):
+        parts = line.split(None, 1)
+        mnemonic = parts[0].upper()
+        operand = parts[1].replace(' ', '') if len(parts) > 1 else ''
+
+        def value(text):
+            if text.startswith('$'):
+                return int(text[1:], 16)
+            if text[0].isdigit():
+                return int(text)
+            return labels.get(text, 0) if not final else labels[text]
+
+        if mnemonic == '.BYTE':
+            return bytes(value(v) for v in operand.split(','))
+        if mnemonic in IMPLIED:
+            return bytes([IMPLIED[mnemonic]])
+        if mnemonic in BRANCHES:
+            offset = value(operand) - (pc + 2)
+            if final and not -128 <= offset < 128:
+                raise ValueError('branch out of range: ' + line)
+            return bytes([BRANCHES[mnemonic], offset & 0xff])
+        if mnemonic in ('JMP', 'JSR'):
+            if operand.startswith('('):
+                target = value(operand[1:-1])
+                return bytes([0x6c, target & 0xff, target >> 8])
+            target = value(operand)
+            return bytes([0x4c if mnemonic == 'JMP' else 0x20, target & 0xff, target >> 8])
+
+        if operand in ('', 'A'):
+            mode, address = 'acc', None
+        elif operand.startswith('#'):
+            mode, address = 'imm', value(operand[1:])
+        elif operand.startswith('(') and operand.endswith(',X)'):
+            mode, address = 'izx', value(operand[1:-3])
+        elif operand.startswith('(') and operand.endswith('),Y'):
+            mode, address = 'izy', value(operand[1:-3])
+        else:
+            index = ''
+            if operand.endswith(',X') or operand.endswith(',Y'):
+                operand, index = operand[:-2], operand[-1].lower()
+            address = value(operand)
+            # Labels and addresses written with 4 digits are absolute
+            absolute = address > 0xff or not operand.startswith('$') or len(operand) > 3
+            mode = ('ab' + index if index else 'abs') if absolute else 'zp' + index
+
+        if mnemonic in GROUP1:
+            opcode = GROUP1[mnemonic] + GROUP1_MODES[mode]
+        else:
+            opcode = GROUP2[mnemonic] + GROUP2_MODES[mode]
+        if mode == 'acc':
+            return bytes([opcode])
+        if mode in ('imm', 'zp', 'zpx', 'zpy', 'izx', 'izy'):
+            return bytes([opcode, address & 0xff])
+        return bytes([opcode, address & 0xff, address >> 8])
+
+
+def build_rom(source, mapper=0, origin=0x8000, prg_banks=2, chr_data=b''):
+    """iNES image with the program at origin, counted from the end of a PRG-ROM that is otherwise
+    filled with NOPs, so that it is in the bank every mapper maps last at power on. The vectors
+    point to the labels nmi, reset and irq, or to reset if there is no such label"""
+    code, labels = Assembler(origin).assemble(source)
+    prg = bytearray([0xea] * (prg_banks * 0x4000))
+    start = len(prg) - (0x10000 - origin)
+    prg[start:start + len(code)] = code
+    reset = labels['reset']
+    vectors = [labels.get('nmi', reset), reset, labels.get('irq', reset)]
+    prg[-6:] = bytes(b for v in vectors for b in (v & 0xff, v >> 8))
+    chr_rom = bytearray(0x2000)
+    chr_rom[:len(chr_data)] = chr_data
+    header = b'NES\x1a' + bytes([prg_banks, 1, (mapper & 0xf) << 4, mapper & 0xf0]) + bytes(8)
+    return header + bytes(prg) + bytes(chr_rom)
+
+
+# Arithmetic, shifts, stack and indexed accesses to RAM, no I/O at all: the CPU's
+# instruction dispatch with the PPU idle, rendering off
+ALU = '''
+reset:
+    SEI
+    CLD
+    LDX #$FF
+    TXS
+    LDA #$00
+    STA $2000
+    STA $2001
+    LDA #$00
+    STA $20
+    LDA #$03
+    STA $21
+loop:
+    LDX #$00
+inner:
+    ADC $10
+    ADC #$03
+    CMP #$40
+    STA $11
+    BIT $11
+    LSR A
+    ROL A
+    INC $12
+    LDA $12
+    EOR #$55
+    AND $11
+    ORA #$01
+    SBC #$02
+    STA $0300,X
+    LDY $0300,X
+    TYA
+    STA ($20),Y
+    LDA $0200,Y
+    PHA
+    PLA
+    JSR sub
+    INX
+    CPX #$80
+    BNE inner
+    JMP loop
+sub:
+    ASL $13
+    ROR $13
+    DEC $14
+    RTS
+'''
+
+# Sprite 0 over a background of solid tiles, with rendering on. Every frame the program polls
+# PPUSTATUS until the sprite-0 hit, then turns the background off and on again a number of cycles
+# later that changes from frame to frame. The switches land mid-scanline on the dot the CPU gets to
+# them, so the picture shows any difference in when the core sees the hit, catches the PPU up or
+# takes the NMI, which interrupts the polling for the end of the hit
+SPRITE0 = '''
+reset:
+    SEI
+    CLD
+    LDX #$FF
+    TXS
+    LDA #$00
+    STA $2000
+    STA $2001
+    STA $00
+vblank1:
+    BIT $2002
+    BPL vblank1
+vblank2:
+    BIT $2002
+    BPL vblank2
+    LDA #$3F
+    STA $2006
+    LDA #$00
+    STA $2006
+    LDA #$0F
+    STA $2007
+    LDA #$16
+    STA $2007
+    LDA #$27
+    STA $2007
+    LDA #$30
+    STA $2007
+    LDA #$3F
+    STA $2006
+    LDA #$11
+    STA $2006
+    LDA #$21
+    STA $2007
+    LDA #$20
+    STA $2006
+    LDA #$00
+    STA $2006
+    LDA #$01
+    LDY #$04
+page:
+    LDX #$00
+tile:
+    STA $2007
+    INX
+    BNE tile
+    DEY
+    BNE page
+    LDA #$00
+    STA $2003
+    LDA #$64
+    STA $2004
+    LDA #$01
+    STA $2004
+    LDA #$00
+    STA $2004
+    LDA #$78
+    STA $2004
+    LDA #$00
+    STA $2003
+    STA $2005
+    STA $2005
+    LDA #$1E
+    STA $2001
+    LDA #$80
+    STA $2000
+frame:
+    INC $02
+    BIT $2002
+    BVS frame
+hit:
+    BIT $2002
+    BVC hit
+    LDA #$16
+    STA $2001
+    LDX $00
+delay:
+    DEX
+    BNE delay
+    LDA #$1E
+    STA $2001
+    INC $00
+    JMP frame
+nmi:
+    INC $01
+    RTI
+'''
+# Tile 1 of the pattern table, opaque everywhere
+SOLID_TILE = bytes(16) + bytes([0xff] * 8) + bytes(8)
+
+# Writes and reads of PPUDATA in a loop with rendering off, the PPU registers as hot as they get:
+# the I/O register dispatch of the bus and the PPU's VRAM access. Every pass starts a byte further
+# on, so the reads return what earlier passes wrote, the loop counter among it, and that ends up in
+# the trace
+PPUDATA = '''
+reset:
+    SEI
+    CLD
+    LDX #$FF
+    TXS
+    LDA #$00
+    STA $2000
+    STA $2001
+loop:
+    LDA #$20
+    STA $2006
+    INX
+    STX $2006
+    LDY #$00
+access:
+    STY $2007
+    STA $2007
+    STA $2007
+    STA $2007
+    LDA $2007
+    LDA $2007
+    LDA $2007
+    LDA $2007
+    INY
+    BNE access
+    JMP loop
+'''
+
+# Scrolling background with 64 moving sprites copied by OAM DMA in the NMI, run on each of the
+# common mappers with the program in the bank they all map last at power on, so the frame rates
+# can be compared per mapper. {setup} and {irq} take the mapper's own code
+RENDER = '''
+reset:
+    SEI
+    CLD
+    LDX #$FF
+    TXS
+    LDA #$00
+    STA $2000
+    STA $2001
+    STA $10
+    STA $11
+{setup}
+vblank1:
+    BIT $2002
+    BPL vblank1
+vblank2:
+    BIT $2002
+    BPL vblank2
+    LDA #$3F
+    STA $2006
+    LDA #$00
+    STA $2006
+    LDX #$00
+palette:
+    TXA
+    STA $2007
+    INX
+    CPX #$20
+    BNE palette
+    LDA #$20
+    STA $2006
+    LDA #$00
+    STA $2006
+    LDY #$04
+page:
+    TXA
+    STA $2007
+    INX
+    BNE page
+    DEY
+    BNE page
+sprites:
+    TXA
+    STA $0200,X
+    INX
+    BNE sprites
+    LDA #$88
+    STA $2000
+    LDA #$1E
+    STA $2001
+frame:
+    LDA $11
+wait:
+    CMP $11
+    BEQ wait
+    LDX #$00
+move:
+    INC $0203,X
+    INX
+    INX
+    INX
+    INX
+    BNE move
+    INC $10
+    JMP frame
+nmi:
+    PHA
+    LDA #$00
+    STA $2003
+    LDA #$02
+    STA $4014
+    LDA $10
+    STA $2005
+    LDA #$00
+    STA $2005
+    INC $11
+    PLA
+    RTI
+{irq}
+'''
+
+# MMC3: CHR banks in order, and a scanline IRQ every 64 lines that scrolls the rest of the
+# picture further, so the counter's clocking shows in the picture
+MMC3_SETUP = '''
+    LDX #$00
+banks:
+    STX $8000
+    LDA chrbanks,X
+    STA $8001
+    INX
+    CPX #$06
+    BNE banks
+    LDA #$01
+    STA $A000
+    LDA #$3F
+    STA $C000
+    STA $C001
+    STA $E001
+    CLI
+'''
+MMC3_IRQ = '''
+irq:
+    PHA
+    STA $E000
+    STA $E001
+    LDA $10
+    ASL A
+    STA $2005
+    STA $2005
+    PLA
+    RTI
+chrbanks:
+    .BYTE $00,$02,$04,$05,$06,$07
+'''
+# Pattern tables of pseudo-random bits, so that every tile and sprite shows
+PATTERNS = bytes((i * 0x9d >> 4 ^ i >> 5) & 0xff for i in range(0x2000))
+
+WORKLOADS = {
+    'alu': dict(source=ALU),
+    'sprite0': dict(source=SPRITE0, chr_data=SOLID_TILE),
+    'ppudata': dict(source=PPUDATA),
+    'nrom': dict(source=RENDER.format(setup='', irq=''), chr_data=PATTERNS),
+    'sxrom': dict(source=RENDER.format(setup='', irq=''), mapper=1, prg_banks=8, origin=0xc000,
+                  chr_data=PATTERNS),
+    'uxrom': dict(source=RENDER.format(setup='', irq=''), mapper=2, prg_banks=8, origin=0xc000,
+                  chr_data=PATTERNS),
+    'mmc3': dict(source=RENDER.format(setup=MMC3_SETUP, irq=MMC3_IRQ), mapper=4, prg_banks=8,
+                 origin=0xe000, chr_data=PATTERNS),
+}
+
+# md5 of the --decode-trace text of the first TRACE_FRAMES frames of every workload
+TRACE_FRAMES = 10
+TRACE_HASHES = {
+    'alu': 'fc63318fb4d2a9745c9ceee5ac8078a6',
+    'sprite0': 'e4d8734f3981c95f310114a6b5375000',
+    'ppudata': '4aff5425f8c060fd7c7c37859f8f9ef9',
+    'nrom': 'a40d69639d0115304806a073b654315b',
+    'sxrom': '2b13b2f64ea78976b09658497ec5a57a',
+    'uxrom': '2b13b2f64ea78976b09658497ec5a57a',
+    'mmc3': '8f1b515714790fc8d30adb09cd589e43',
+}
+
+# Hash of the picture of the last of the CHECK_FRAMES frames run by --verify-accuracy
+CHECK_FRAMES = 60
+FRAME_HASHES = {
+    'alu': '775523dc4bf96325',
+    'sprite0': '562ae5b7355dc8c7',
+    'ppudata': '775523dc4bf96325',
+    'nrom': '4ce905a5ec9eb543',
+    'sxrom': '23ca1ece43fa5288',
+    'uxrom': '4ce905a5ec9eb543',
+    'mmc3': '830912289de5649d',
+}
+
+
+def write_workloads(directory):
+    paths = {}
+    for name, workload in WORKLOADS.items():
+        paths[name] = os.path.join(directory, name + '.nes')
+        with open(paths[name], 'wb') as rom:
+            rom.write(build_rom(**workload))
+    return paths
+
+
+def benchmark(binaries, paths, frames, runs):
+    best = {}
+    for run in range(runs):
+        for name, path in paths.items():
+            for binary in binaries:
+                output = subprocess.run([binary, '--benchmark', str(frames), path], capture_output=True,
+                                        text=True).stdout
+                match = re.search(r'([\d.]+) frames/s', output)
+                if not match:
+                    sys.exit('No benchmark result from {} on {}'.format(binary, name))
+                key = (name, binary)
+                best[key] = max(best.get(key, 0), float(match.group(1)))
+
+    print('{:<12}'.format('frames/s') + ''.join('{:>14}'.format(os.path.basename(b)[:13]) for b in binaries))
+    for name in paths:
+        print('{:<12}'.format(name) + ''.join('{:>14.1f}'.format(best[(name, b)]) for b in binaries))
+
+
+def check(binary, paths, frames, directory):
+    failed = False
+    for name, path in paths.items():
+        errors = []
+        result = subprocess.run([binary, '--verify-accuracy', str(frames), path], capture_output=True, text=True)
+        if result.returncode != 0:
+            errors.append('differs from the cycle accurate CPU')
+        else:
+            match = re.search(r'last frame hash ([0-9a-f]+)', result.stdout)
+            frame_hash = match.group(1) if match else None
+            if frame_hash != FRAME_HASHES.get(name):
+                errors.append('frame hash {}, expected {}'.format(frame_hash, FRAME_HASHES.get(name)))
+
+        subprocess.run([binary, '--benchmark', str(TRACE_FRAMES), '--log-cpu', path], cwd=directory,
+                       capture_output=True)
+        trace = subprocess.run([binary, '--decode-trace', os.path.join(directory, 'sn.cputrace')],
+                               capture_output=True).stdout
+        digest = hashlib.md5(trace).hexdigest()
+        if digest != TRACE_HASHES.get(name):
+            errors.append('trace hash {}, expected {}'.format(digest, TRACE_HASHES.get(name)))
+
+        for error in errors:
+            print('{}: {}'.format(name, error))
+        if not errors:
+            print('{}: ok'.format(name))
+        failed = failed or bool(errors)
+    return not failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('binaries', nargs='*', help='SimpleNES executables to run')
+    parser.add_argument('--frames', type=int, default=1200, help='frames per benchmark run (default 1200)')
+    parser.add_argument('--runs', type=int, default=5, help='runs per workload, the best counts (default 5)')
+    parser.add_argument('--check', action='store_true', help='check the workloads instead of timing them')
+    parser.add_argument('--write', metavar='DIR', help='write the workload ROMs to DIR and exit')
+    parser.add_argument('--workload', action='append', choices=sorted(WORKLOADS), help='only run these')
+    args = parser.parse_args()
+
+    if args.write:
+        os.makedirs(args.write, exist_ok=True)
+        write_workloads(args.write)
+        return 0
+    if not args.binaries:
+        parser.error('no SimpleNES executable given')
+
+    with tempfile.TemporaryDirectory() as directory:
+        paths = write_workloads(directory)
+        if args.workload:
+            paths = {name: paths[name] for name in args.workload}
+        binaries = [os.path.abspath(b) for b in args.binaries]
+        if args.check:
+            return 0 if check(binaries[0], paths, CHECK_FRAMES, directory) else 1
+        benchmark(binaries, paths, args.frames, args.runs)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())